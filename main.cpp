@@ -1,25 +1,94 @@
+#include <atomic>
 #include <bit>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <queue>
 #include <random>
 #include <string>
+#include <thread>
 #include <unordered_set>
 
 #include <unistd.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
 #include <arm_acle.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 static std::mt19937 rng;
 
+// solver progress chatter, turned off when solving in bulk
+static bool solver_output = true;
+
+__attribute__((format(printf, 1, 2)))
+static void solver_printf(char const * fmt, ...)
+{
+    if (solver_output) {
+        va_list args;
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+    }
+}
+
+// Set on the threads solve_portfolio starts. Solvers poll it in their main
+// loops and give up once it is set, returning no solutions
+static thread_local std::atomic<bool> const * solver_stop = nullptr;
+
+static bool stop_requested()
+{
+    return solver_stop && solver_stop->load(std::memory_order_relaxed);
+}
+
+// points this thread's solver_stop at stop for as long as it lives, then puts
+// back whatever it was before, so searches can nest
+struct solver_stop_scope
+{
+    explicit solver_stop_scope(std::atomic<bool> const * stop) : previous{solver_stop}
+    {
+        solver_stop = stop;
+    }
+
+    solver_stop_scope(solver_stop_scope const &) = delete;
+    solver_stop_scope & operator=(solver_stop_scope const &) = delete;
+
+    ~solver_stop_scope()
+    {
+        solver_stop = previous;
+    }
+
+    std::atomic<bool> const * previous;
+};
+
 static constexpr size_t k_board_width = 16;
 static constexpr size_t k_board_height = 16;
 
 static char const game_filename[] = "robots_game.bak";
+static char const pattern_db_filename[] = "robots_pattern.db";
 
 enum class color_t : uint8_t
 {
@@ -112,6 +181,12 @@ enum class direction_t : uint8_t
 };
 using enum direction_t;
 
+static direction_t reverse(direction_t dir)
+{
+    // UP/DOWN and LEFT/RIGHT only differ in the low bit
+    return static_cast<direction_t>(static_cast<uint8_t>(dir) ^ 1);
+}
+
 static char const * to_str(direction_t dir)
 {
     switch (dir) {
@@ -122,6 +197,22 @@ static char const * to_str(direction_t dir)
     }
 }
 
+// how game_state computes where a sliding robot stops
+enum class move_engine_t : uint8_t
+{
+    TABLE,    // per-square wall-only stop table, clamped against robots
+    BITBOARD, // per-row/column wall masks and bit scans
+};
+using enum move_engine_t;
+
+static char const * to_str(move_engine_t e)
+{
+    switch (e) {
+    case TABLE: return "table";
+    case BITBOARD: return "bitboard";
+    }
+}
+
 struct target
 {
     target() = default;
@@ -168,10 +259,11 @@ namespace std
 
 static position random_pos()
 {
-    std::uniform_int_distribution<uint8_t> row_dis(0, k_board_width - 1);
-    std::uniform_int_distribution<uint8_t> col_dis(0, k_board_height - 1);
+    // uint8_t isn't one of the types uniform_int_distribution takes
+    std::uniform_int_distribution<unsigned> row_dis(0, k_board_height - 1);
+    std::uniform_int_distribution<unsigned> col_dis(0, k_board_width - 1);
 
-    return {row_dis(rng), col_dis(rng)};
+    return {static_cast<uint8_t>(row_dis(rng)), static_cast<uint8_t>(col_dis(rng))};
 }
 
 struct robot : position
@@ -209,21 +301,67 @@ struct robot_array : std::array<robot, k_num_robots>
         static_assert(sizeof(*this) == 4);
         return std::bit_cast<uint32_t>(*this);
     }
+
+    static robot_array from_raw(uint32_t raw)
+    {
+        return std::bit_cast<robot_array>(raw);
+    }
 };
 
-// https://stackoverflow.com/a/7666577/3775803
-static size_t hash(unsigned char const * str, size_t len)
+// Hash of a packed robot_array for the visited tables, which index with the low
+// bits. CRC32C mixes all 32 input bits into every output bit in a single
+// instruction on both ARM (with the CRC extension) and x86 (SSE4.2). On x86
+// builds that don't assume SSE4.2 the instruction is picked at runtime. The
+// fallback is a multiply-shift, taking the well mixed high half of the product,
+// which is also what anything kept on disk hashes with since it is the same on
+// every build and CPU.
+static uint32_t hash_multiply_shift(uint32_t raw)
 {
-    unsigned char const * end = str + len;
-    size_t hash = 5381;
+    return static_cast<uint32_t>((raw * UINT64_C(0x9e3779b97f4a7c15)) >> 32);
+}
 
-    while (str != end) {
-        hash = ((hash << 5) + hash) + *str++; /* hash * 33 + c */
-    }
+#if defined(__ARM_FEATURE_CRC32)
+
+static uint32_t hash(uint32_t raw)
+{
+    return __crc32cw(0, raw);
+}
+
+#elif defined(__SSE4_2__)
+
+static uint32_t hash(uint32_t raw)
+{
+    return _mm_crc32_u32(0, raw);
+}
+
+#elif defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.2")))
+static uint32_t hash_crc32(uint32_t raw)
+{
+    return _mm_crc32_u32(0, raw);
+}
+
+// static initializers can run before the CPU model is, so set it up first
+static bool const cpu_has_crc32 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}();
 
-    return hash;
+static uint32_t hash(uint32_t raw)
+{
+    return cpu_has_crc32 ? hash_crc32(raw) : hash_multiply_shift(raw);
+}
+
+#else
+
+static uint32_t hash(uint32_t raw)
+{
+    return hash_multiply_shift(raw);
 }
 
+#endif
+
 namespace std
 {
     template <> struct hash<robot_array>
@@ -231,7 +369,7 @@ namespace std
         size_t operator()(robot_array const & r) const
         {
             static_assert(std::has_unique_object_representations_v<robot_array>);
-            return ::hash(reinterpret_cast<unsigned char const *>(r.data()), sizeof(r));
+            return ::hash(r.raw());
         }
     };
 }
@@ -265,6 +403,12 @@ struct moves_vec
         moves[count++] = move(std::forward<Ts>(args)...);
     }
 
+    void pop_back()
+    {
+        assert(count > 0);
+        --count;
+    }
+
     void clear()
     {
         count = 0;
@@ -295,6 +439,128 @@ private:
     size_t count = 0;
 };
 
+// a state one move away from another, and the move that gets there
+struct successor
+{
+    robot_array robots;
+    move mv;
+};
+
+// every state one move away from a given one, at most one per robot and
+// direction
+struct successors_vec
+{
+    void emplace_back(robot_array const & robots, move mv)
+    {
+        assert(count < std::size(items));
+        items[count++] = {robots, mv};
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    template <typename Pred>
+    void remove_if(Pred pred)
+    {
+        count = std::remove_if(items, items + count, pred) - items;
+    }
+
+    successor const * begin() const { return items; }
+    successor const * end() const { return items + count; }
+
+private:
+    successor items[k_num_robots * 4];
+    size_t count = 0;
+};
+
+// Two-robot pattern database, written by build_pattern_db and mapped
+// read-only at startup. For every target it holds a table of the fewest moves
+// a robot needs to get onto the target from each square with one helper robot
+// on another square, indexed [robot][helper] by their bytes in
+// robot_array::raw(). The other two robots are left out and may stop either
+// robot anywhere along a slide, as in target_distance, so the tables never
+// overestimate and the max over helpers is an admissible bound
+struct pattern_db
+{
+    static constexpr uint32_t k_magic = 0x42445052; // "RPDB"
+    static constexpr size_t k_max_targets = 32;
+    static constexpr size_t k_table_size = 256 * 256;
+
+    // the file is this header followed by num_targets tables
+    struct header
+    {
+        uint32_t magic;
+        uint32_t fingerprint; // of the walls the tables were built for
+        uint32_t num_targets;
+        target targets[k_max_targets];
+    };
+
+    // null if the file can't be mapped or was built for other walls
+    static std::unique_ptr<pattern_db> open(char const * filename, uint32_t fingerprint)
+    {
+        int fd = ::open(filename, O_RDONLY);
+        if (fd == -1) {
+            return nullptr;
+        }
+        struct stat st;
+        size_t const size = fstat(fd, &st) == 0 ? st.st_size : 0;
+        void * mem = size >= sizeof(header) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                                            : MAP_FAILED;
+        close(fd);
+        if (mem == MAP_FAILED) {
+            return nullptr;
+        }
+
+        auto db = std::unique_ptr<pattern_db>(new pattern_db(filename, mem, size));
+        header const & h = db->get_header();
+        if (h.magic != k_magic || h.fingerprint != fingerprint || h.num_targets > k_max_targets ||
+            size != sizeof(header) + h.num_targets * k_table_size) {
+            fprintf(stderr, "ignoring stale pattern database %s\n", filename);
+            return nullptr;
+        }
+        return db;
+    }
+
+    pattern_db(pattern_db const &) = delete;
+    pattern_db & operator=(pattern_db const &) = delete;
+
+    ~pattern_db()
+    {
+        munmap(mem, size);
+    }
+
+    char const * get_path() const
+    {
+        return path.c_str();
+    }
+
+    // the table for t, or null if there isn't one
+    uint8_t const * table(target const & t) const
+    {
+        header const & h = get_header();
+        for (uint32_t i = 0; i < h.num_targets; ++i) {
+            if (h.targets[i] == t) {
+                return static_cast<uint8_t const *>(mem) + sizeof(header) + i * k_table_size;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    pattern_db(char const * p, void * m, size_t s) : path{p}, mem{m}, size{s} {}
+
+    header const & get_header() const
+    {
+        return *static_cast<header const *>(mem);
+    }
+
+    std::string path;
+    void * mem;
+    size_t size;
+};
+
 struct game_state
 {
     game_state();
@@ -313,10 +579,65 @@ struct game_state
 
     moves_vec valid_moves(robot_array const & robots) const;
 
+    // valid_moves and play for every move at once
+    successors_vec successors(robot_array const & robots) const;
+
+    // successors of robots, which was reached from parent by last_move, less
+    // the ones that can't be on a shortest path that way. parent == robots for
+    // the start state, which has nothing pruned
+    successors_vec successors(robot_array const & robots, robot_array const & parent,
+                              move last_move) const;
+
     bool target_achieved(robot_array const & robots) const;
 
+    // the moves that reach the current target in one slide from robots
+    moves_vec final_moves(robot_array const & robots) const;
+
+    robot_array canonical(robot_array const & robots) const;
+
+    // lower bound on the number of moves needed to reach the current target
+    unsigned min_moves(robot_array const & robots) const
+    {
+        if (target_square.color == RAINBOW) {
+            unsigned best = std::numeric_limits<unsigned>::max();
+            for (robot const & r : robots) {
+                best = std::min(best, min_moves(robots, r));
+            }
+            return best;
+        }
+        return min_moves(robots, robots.get_robot(target_square.color));
+    }
+
+    // lower bound on the number of moves for r to reach the current target.
+    // The pattern table, if there is one, is never lower than target_distance
+    unsigned min_moves(robot_array const & robots, robot const & r) const
+    {
+        if (!pattern_table) {
+            return target_distance[r.row][r.col];
+        }
+        uint8_t const * helpers = pattern_table + (r.row | (r.col << 4)) * 256;
+        unsigned bound = 0;
+        for (robot const & helper : robots) {
+            if (&helper != &r) {
+                bound = std::max<unsigned>(bound, helpers[helper.row | (helper.col << 4)]);
+            }
+        }
+        return bound;
+    }
+
+    // fill a pattern_db table for the current target
+    void build_pattern_table(uint8_t * table) const;
+
+    // changes whenever the walls do, to tell stale pattern databases apart
+    uint32_t wall_fingerprint() const
+    {
+        return fingerprint;
+    }
+
     bool select_new_target();
 
+    void set_target(target t);
+
     square const & get_square(position pos) const
     {
         assert(pos.row < k_board_height && pos.col < k_board_width);
@@ -328,6 +649,22 @@ struct game_state
         return target_square;
     }
 
+    move_engine_t get_move_engine() const
+    {
+        return engine;
+    }
+
+    void set_move_engine(move_engine_t e)
+    {
+        engine = e;
+    }
+
+    // where the pattern database was loaded from, or null if there isn't one
+    char const * get_pattern_db_path() const
+    {
+        return patterns ? patterns->get_path() : nullptr;
+    }
+
     void save_state(char const * filename, robot_array const & robots);
     robot_array load_state(char const * filename);
 
@@ -335,15 +672,70 @@ private:
 
     void init_board();
     void init_targets();
+    void init_slides();
+    void init_bitboards();
+    void init_fingerprint();
+    void init_target_distance();
 
     std::optional<position> can_move(robot_array const & robots, robot const & r, direction_t dir) const;
 
+    position slide(robot_array const & robots, robot const & r, direction_t dir) const
+    {
+        if (engine == BITBOARD) {
+            return slide_bitboard(robots, r, dir);
+        }
+        return slide_table(robots, r, dir);
+    }
+
+    position slide_table(robot_array const & robots, robot const & r, direction_t dir) const;
+    position slide_bitboard(robot_array const & robots, robot const & r, direction_t dir) const;
+
+    move_engine_t engine = TABLE;
+
+    // whether successors() prunes by the last move, off with PRUNE_MOVES=0 to
+    // check that it changes nothing but the work done
+    bool prune_moves = true;
+
     target target_square;
+    position target_pos;
 
     std::vector<target> all_targets;
 
     // upper left is 0, 0. First coordinate is row, second is column
     square board[k_board_height][k_board_width];
+
+    // where a robot starting on a given square stops when moving in each
+    // direction if there are no other robots on the board, i.e. only walls are
+    // considered. Indexed by [row][col][direction]
+    position slide_stops[k_board_height][k_board_width][4];
+
+    // slide_stops again, but indexed by a robot's byte in robot_array::raw()
+    // and giving the stop in the same packed form. The four directions for a
+    // square are contiguous so they can be loaded as one word
+    alignas(4) uint8_t packed_stops[256][4];
+
+    // bitboard form of the walls. Bit i of stops_right[row] is set if a robot
+    // moving right along that row has to stop on column i, and so on for the
+    // other directions. Columns are indexed by row number
+    uint16_t stops_up[k_board_width];
+    uint16_t stops_down[k_board_width];
+    uint16_t stops_left[k_board_height];
+    uint16_t stops_right[k_board_height];
+
+    // minimum number of moves for a lone robot to get from each square to the
+    // current target, assuming it can be stopped anywhere it likes by other
+    // robots. Never more than the real number of moves, so usable as an
+    // admissible heuristic. Rebuilt whenever the target changes
+    uint8_t target_distance[k_board_height][k_board_width];
+
+    // hash of the walls, worked out once since they never change after
+    // construction
+    uint32_t fingerprint = 0;
+
+    // the pattern database found at startup, if any, and its table for the
+    // current target
+    pattern_db const * patterns = nullptr;
+    uint8_t const * pattern_table = nullptr;
 };
 
 void game_state::init_board()
@@ -463,13 +855,160 @@ bool game_state::select_new_target()
 
     target_square = all_targets.back();
     all_targets.pop_back();
+    init_target_distance();
     return true;
 }
 
+void game_state::set_target(target t)
+{
+    target_square = t;
+    init_target_distance();
+}
+
+// the square next to pos in direction dir, which has to be on the board
+static position step(position pos, direction_t dir)
+{
+    switch (dir) {
+    case UP: pos.row = pos.row - 1; break;
+    case DOWN: pos.row = pos.row + 1; break;
+    case LEFT: pos.col = pos.col - 1; break;
+    case RIGHT: pos.col = pos.col + 1; break;
+    }
+    return pos;
+}
+
+void game_state::init_target_distance()
+{
+    std::fill_n(&target_distance[0][0], k_board_height * k_board_width,
+                std::numeric_limits<uint8_t>::max());
+
+    std::vector<position> frontier;
+    for (uint8_t row = 0; row < k_board_height; ++row) {
+        for (uint8_t col = 0; col < k_board_width; ++col) {
+            if (board[row][col].target == target_square) {
+                target_distance[row][col] = 0;
+                target_pos = position(row, col);
+                frontier.emplace_back(row, col);
+            }
+        }
+    }
+    assert(frontier.size() == 1);
+
+    // with optional stoppers a robot can get to any square between where it
+    // starts and its wall-only stop, and walls block both ways, so we can walk
+    // outwards from the target
+    std::vector<position> next_frontier;
+    for (uint8_t dist = 1; !frontier.empty(); ++dist) {
+        for (position pos : frontier) {
+            for (direction_t dir : {UP, DOWN, LEFT, RIGHT}) {
+                position const stop = slide_stops[pos.row][pos.col][static_cast<uint8_t>(dir)];
+                position cur = pos;
+                while (cur != stop) {
+                    cur = step(cur, dir);
+                    if (target_distance[cur.row][cur.col] > dist) {
+                        target_distance[cur.row][cur.col] = dist;
+                        next_frontier.push_back(cur);
+                    }
+                }
+            }
+        }
+        std::swap(frontier, next_frontier);
+        next_frontier.clear();
+    }
+
+    pattern_table = patterns ? patterns->table(target_square) : nullptr;
+}
+
+void game_state::build_pattern_table(uint8_t * table) const
+{
+    std::fill_n(table, pattern_db::k_table_size, std::numeric_limits<uint8_t>::max());
+
+    // (robot, helper) pairs of packed squares, starting from every pair with
+    // the robot on the target
+    std::vector<std::pair<uint8_t, uint8_t>> frontier;
+    uint8_t const goal = target_pos.row | (target_pos.col << 4);
+    for (unsigned helper = 0; helper < 256; ++helper) {
+        if (helper != goal) {
+            table[goal * 256 + helper] = 0;
+            frontier.emplace_back(goal, helper);
+        }
+    }
+
+    // as in init_target_distance every move can be undone, since the robot
+    // that doesn't move blocks both ways just like a wall. So walk outwards,
+    // moving either robot to any square short of its stop
+    std::vector<std::pair<uint8_t, uint8_t>> next_frontier;
+    for (uint8_t dist = 1; !frontier.empty(); ++dist) {
+        for (auto const & [r, helper] : frontier) {
+            for (bool const move_helper : {false, true}) {
+                uint8_t const moving = move_helper ? helper : r;
+                uint8_t const still = move_helper ? r : helper;
+                position const from(moving & 15, moving >> 4);
+                position const blocker(still & 15, still >> 4);
+                for (direction_t dir : {UP, DOWN, LEFT, RIGHT}) {
+                    position const stop = slide_stops[from.row][from.col][static_cast<uint8_t>(dir)];
+                    position cur = from;
+                    while (cur != stop) {
+                        cur = step(cur, dir);
+                        if (cur == blocker) {
+                            break;
+                        }
+                        uint8_t const packed = cur.row | (cur.col << 4);
+                        auto const next = move_helper ? std::pair(r, packed) : std::pair(packed, helper);
+                        uint8_t & entry = table[next.first * 256 + next.second];
+                        if (entry > dist) {
+                            entry = dist;
+                            next_frontier.push_back(next);
+                        }
+                    }
+                }
+            }
+        }
+        std::swap(frontier, next_frontier);
+        next_frontier.clear();
+    }
+}
+
+void game_state::init_fingerprint()
+{
+    // FNV-1a over the wall-only stops, which is everything the tables depend on
+    fingerprint = 2166136261u;
+    for (uint8_t const * b = &packed_stops[0][0]; b != &packed_stops[0][0] + sizeof packed_stops; ++b) {
+        fingerprint = (fingerprint ^ *b) * 16777619u;
+    }
+}
+
+// where the pattern database lives, PATTERN_DB if set. An empty PATTERN_DB
+// turns it off
+static char const * pattern_db_path()
+{
+    char const * path = getenv("PATTERN_DB");
+    return path ? path : pattern_db_filename;
+}
+
 game_state::game_state()
 {
     init_board();
     init_targets();
+    init_slides();
+    init_bitboards();
+    init_fingerprint();
+
+    // mapped once and shared by every game_state for the life of the process
+    static std::unique_ptr<pattern_db> const db = pattern_db::open(pattern_db_path(), wall_fingerprint());
+    patterns = db.get();
+
+    if (char const * prune_env = getenv("PRUNE_MOVES")) {
+        prune_moves = strcmp(prune_env, "0") != 0;
+    }
+
+    if (char const * engine_env = getenv("MOVE_ENGINE")) {
+        if (strcmp(engine_env, to_str(BITBOARD)) == 0) {
+            engine = BITBOARD;
+        } else {
+            assert(strcmp(engine_env, to_str(TABLE)) == 0);
+        }
+    }
 }
 
 void game_state::init_targets()
@@ -575,66 +1114,453 @@ std::optional<position> game_state::can_move(robot_array const & robots,
     }
 }
 
-void game_state::move_robot(robot_array const & robots, robot & r, direction_t dir) const
+void game_state::init_slides()
 {
-    std::optional<position> pos;
-    while ((pos = can_move(robots, r, dir))) {
-        static_cast<position &>(r) = *pos;
+    // walk each square to its wall-only stop once, so that moves never have to
+    // look at the board again. Robots are resolved later in slide()
+    for (uint8_t row = 0; row < k_board_height; ++row) {
+        for (uint8_t col = 0; col < k_board_width; ++col) {
+            for (direction_t dir : {UP, DOWN, LEFT, RIGHT}) {
+                robot r;
+                static_cast<position &>(r) = position(row, col);
+
+                // park every robot on the start square, a slide never comes
+                // back to it so they can't block
+                robot_array no_robots;
+                no_robots.fill(r);
+
+                std::optional<position> pos;
+                while ((pos = can_move(no_robots, r, dir))) {
+                    static_cast<position &>(r) = *pos;
+                }
+                slide_stops[row][col][static_cast<uint8_t>(dir)] = r;
+                packed_stops[row | (col << 4)][static_cast<uint8_t>(dir)] = r.row | (r.col << 4);
+            }
+        }
     }
 }
 
-moves_vec game_state::valid_moves(robot_array const & robots) const
+position game_state::slide_table(robot_array const & robots, robot const & r, direction_t dir) const
 {
-    moves_vec vec;
-
-    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
-        robot const & r = robots.get_robot(color);
-        for (direction_t d : {UP, DOWN, LEFT, RIGHT}) {
-            if (can_move(robots, r, d)) {
-                vec.emplace_back(color, d);
+    position stop = slide_stops[r.row][r.col][static_cast<uint8_t>(dir)];
+
+    // clamp the wall-only stop against any robot sitting between the moving
+    // robot and that stop. The moving robot itself is never in that range
+    for (robot const & other : robots) {
+        switch (dir) {
+        case UP:
+            if (other.col == r.col && other.row < r.row && other.row >= stop.row) {
+                stop.row = other.row + 1;
+            }
+            break;
+        case DOWN:
+            if (other.col == r.col && other.row > r.row && other.row <= stop.row) {
+                stop.row = other.row - 1;
+            }
+            break;
+        case LEFT:
+            if (other.row == r.row && other.col < r.col && other.col >= stop.col) {
+                stop.col = other.col + 1;
+            }
+            break;
+        case RIGHT:
+            if (other.row == r.row && other.col > r.col && other.col <= stop.col) {
+                stop.col = other.col - 1;
             }
+            break;
         }
     }
 
-    return vec;
+    return stop;
 }
 
-bool game_state::target_achieved(robot_array const & robots) const
+void game_state::init_bitboards()
 {
-    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
-        robot const & r = robots.get_robot(color);
-        square const & sq = board[r.row][r.col];
-        if (sq.target && *sq.target == target_square &&
-            (sq.target->color == color || sq.target->color == RAINBOW)) {
-            return true;
+    static_assert(k_board_width == 16 && k_board_height == 16);
+
+    for (unsigned i = 0; i < 16; ++i) {
+        // the board edges always stop a robot
+        stops_up[i] = 1u << 0;
+        stops_down[i] = 1u << 15;
+        stops_left[i] = 1u << 0;
+        stops_right[i] = 1u << 15;
+    }
+
+    for (unsigned row = 0; row < k_board_height; ++row) {
+        for (unsigned col = 0; col < k_board_width; ++col) {
+            square const & sq = board[row][col];
+            if (sq.block_north) {
+                // moving up stops here, moving down stops on the square above
+                stops_up[col] |= 1u << row;
+                if (row > 0) {
+                    stops_down[col] |= 1u << (row - 1);
+                }
+            }
+            if (sq.block_east) {
+                // moving right stops here, moving left stops on the square to the right
+                stops_right[row] |= 1u << col;
+                if (col < k_board_width - 1) {
+                    stops_left[row] |= 1u << (col + 1);
+                }
+            }
         }
     }
-    return false;
+
+    // occupancy masks are built straight from the packed robot_array, so make
+    // sure the packing is what we think it is: one byte per robot, row in the
+    // low nibble
+    robot_array probe;
+    for (robot & r : probe) {
+        static_cast<position &>(r) = position(0, 0);
+    }
+    static_cast<position &>(probe[1]) = position(0x3, 0xa);
+    assert(probe.raw() == 0xa300);
 }
 
-static void do_write(int fd, void const * data, size_t size)
+position game_state::slide_bitboard(robot_array const & robots, robot const & r, direction_t dir) const
 {
-    ssize_t ret = write(fd, data, size);
-    assert(ret == static_cast<ssize_t>(size));
+    // every robot on the same row (for left/right) or column (for up/down) as
+    // the moving one, as a mask of columns or rows
+    uint32_t const raw = robots.raw();
+    uint16_t occupied = 0;
+    for (unsigned i = 0; i < k_num_robots; ++i) {
+        unsigned const row = (raw >> (8 * i)) & 0xf;
+        unsigned const col = (raw >> (8 * i + 4)) & 0xf;
+        if (dir == UP || dir == DOWN) {
+            occupied |= (col == r.col) << row;
+        } else {
+            occupied |= (row == r.row) << col;
+        }
+    }
+
+    // a robot on square i stops us on the square before it, so shift the
+    // occupancy towards the mover and merge with the walls. The mover's own bit
+    // gets shifted behind it where it is masked off
+    position stop = r;
+    switch (dir) {
+    case UP: {
+        uint16_t const mask = (stops_up[r.col] | (occupied << 1)) & ((2u << r.row) - 1);
+        stop.row = 15 - std::countl_zero(mask);
+        break;
+    }
+    case DOWN: {
+        uint16_t const mask = (stops_down[r.col] | (occupied >> 1)) & ~((1u << r.row) - 1);
+        stop.row = std::countr_zero(mask);
+        break;
+    }
+    case LEFT: {
+        uint16_t const mask = (stops_left[r.row] | (occupied << 1)) & ((2u << r.col) - 1);
+        stop.col = 15 - std::countl_zero(mask);
+        break;
+    }
+    case RIGHT: {
+        uint16_t const mask = (stops_right[r.row] | (occupied >> 1)) & ~((1u << r.col) - 1);
+        stop.col = std::countr_zero(mask);
+        break;
+    }
+    }
+
+    return stop;
 }
 
-static void do_read(int fd, void * data, size_t size)
+void game_state::move_robot(robot_array const & robots, robot & r, direction_t dir) const
 {
-    ssize_t ret = read(fd, data, size);
-    assert(ret == static_cast<ssize_t>(size));
+    static_cast<position &>(r) = slide(robots, r, dir);
 }
 
-void game_state::save_state(char const * filename, robot_array const & robots)
+moves_vec game_state::valid_moves(robot_array const & robots) const
 {
-    int fd = open(filename, O_RDWR|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR);
-    printf("open: %s\n", strerror(errno));
-    assert(fd != -1);
-
-
-    do_write(fd, &robots, sizeof robots);
-    do_write(fd, &target_square, sizeof target_square);
+    moves_vec vec;
 
-    uint32_t num_targets = all_targets.size();
+    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+        robot const & r = robots.get_robot(color);
+        for (direction_t d : {UP, DOWN, LEFT, RIGHT}) {
+            if (slide(robots, r, d) != r) {
+                vec.emplace_back(color, d);
+            }
+        }
+    }
+
+    return vec;
+}
+
+successors_vec game_state::successors(robot_array const & robots) const
+{
+    successors_vec vec;
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    if (engine == TABLE) {
+        // The 16 (robot, direction) pairs are the 16 byte lanes of a vector,
+        // lane 4 * robot + direction. Each lane starts at the wall-only stop and
+        // is clamped against each robot in turn, the same way slide_table does
+        // it. Positions are packed as in robot_array::raw(), row in the low
+        // nibble and column in the high nibble.
+        uint32_t const raw = robots.raw();
+        alignas(16) uint32_t pos_words[k_num_robots];
+        alignas(16) uint32_t stop_words[k_num_robots];
+        for (size_t i = 0; i < k_num_robots; ++i) {
+            uint8_t const b = raw >> (8 * i);
+            pos_words[i] = b * 0x01010101u;
+            memcpy(&stop_words[i], packed_stops[b], 4);
+        }
+
+        alignas(16) uint8_t stops[k_num_robots * 4];
+#if defined(__SSE2__)
+        __m128i const nibble = _mm_set1_epi8(0x0f);
+        __m128i const ones = _mm_set1_epi8(-1);
+        __m128i const one = _mm_set1_epi8(1);
+        __m128i const is_up = _mm_set1_epi32(0x000000ff);
+        __m128i const is_down = _mm_set1_epi32(0x0000ff00);
+        __m128i const is_left = _mm_set1_epi32(0x00ff0000);
+        __m128i const is_right = _mm_set1_epi32(0xff000000);
+
+        __m128i const pos = _mm_load_si128(reinterpret_cast<__m128i const *>(pos_words));
+        __m128i const stop = _mm_load_si128(reinterpret_cast<__m128i const *>(stop_words));
+        __m128i const row = _mm_and_si128(pos, nibble);
+        __m128i const col = _mm_and_si128(_mm_srli_epi16(pos, 4), nibble);
+        __m128i stop_row = _mm_and_si128(stop, nibble);
+        __m128i stop_col = _mm_and_si128(_mm_srli_epi16(stop, 4), nibble);
+
+        for (robot const & other : robots) {
+            __m128i const other_row = _mm_set1_epi8(other.row);
+            __m128i const other_col = _mm_set1_epi8(other.col);
+            __m128i const same_row = _mm_cmpeq_epi8(other_row, row);
+            __m128i const same_col = _mm_cmpeq_epi8(other_col, col);
+
+            // rows and columns are < 16 so the signed compares are fine
+            __m128i m = _mm_and_si128(_mm_and_si128(is_up, same_col), _mm_cmpgt_epi8(row, other_row));
+            stop_row = _mm_max_epu8(stop_row, _mm_and_si128(m, _mm_add_epi8(other_row, one)));
+
+            m = _mm_and_si128(_mm_and_si128(is_down, same_col), _mm_cmpgt_epi8(other_row, row));
+            stop_row = _mm_min_epu8(stop_row, _mm_or_si128(_mm_and_si128(m, _mm_sub_epi8(other_row, one)),
+                                                           _mm_andnot_si128(m, ones)));
+
+            m = _mm_and_si128(_mm_and_si128(is_left, same_row), _mm_cmpgt_epi8(col, other_col));
+            stop_col = _mm_max_epu8(stop_col, _mm_and_si128(m, _mm_add_epi8(other_col, one)));
+
+            m = _mm_and_si128(_mm_and_si128(is_right, same_row), _mm_cmpgt_epi8(other_col, col));
+            stop_col = _mm_min_epu8(stop_col, _mm_or_si128(_mm_and_si128(m, _mm_sub_epi8(other_col, one)),
+                                                           _mm_andnot_si128(m, ones)));
+        }
+
+        _mm_store_si128(reinterpret_cast<__m128i *>(stops),
+                        _mm_or_si128(stop_row, _mm_slli_epi16(stop_col, 4)));
+#else
+        uint8x16_t const nibble = vdupq_n_u8(0x0f);
+        uint8x16_t const ones = vdupq_n_u8(0xff);
+        uint8x16_t const one = vdupq_n_u8(1);
+        uint8x16_t const is_up = vreinterpretq_u8_u32(vdupq_n_u32(0x000000ff));
+        uint8x16_t const is_down = vreinterpretq_u8_u32(vdupq_n_u32(0x0000ff00));
+        uint8x16_t const is_left = vreinterpretq_u8_u32(vdupq_n_u32(0x00ff0000));
+        uint8x16_t const is_right = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+
+        uint8x16_t const pos = vreinterpretq_u8_u32(vld1q_u32(pos_words));
+        uint8x16_t const stop = vreinterpretq_u8_u32(vld1q_u32(stop_words));
+        uint8x16_t const row = vandq_u8(pos, nibble);
+        uint8x16_t const col = vshrq_n_u8(pos, 4);
+        uint8x16_t stop_row = vandq_u8(stop, nibble);
+        uint8x16_t stop_col = vshrq_n_u8(stop, 4);
+
+        for (robot const & other : robots) {
+            uint8x16_t const other_row = vdupq_n_u8(other.row);
+            uint8x16_t const other_col = vdupq_n_u8(other.col);
+            uint8x16_t const same_row = vceqq_u8(other_row, row);
+            uint8x16_t const same_col = vceqq_u8(other_col, col);
+
+            uint8x16_t m = vandq_u8(vandq_u8(is_up, same_col), vcgtq_u8(row, other_row));
+            stop_row = vmaxq_u8(stop_row, vandq_u8(m, vaddq_u8(other_row, one)));
+
+            m = vandq_u8(vandq_u8(is_down, same_col), vcgtq_u8(other_row, row));
+            stop_row = vminq_u8(stop_row, vbslq_u8(m, vsubq_u8(other_row, one), ones));
+
+            m = vandq_u8(vandq_u8(is_left, same_row), vcgtq_u8(col, other_col));
+            stop_col = vmaxq_u8(stop_col, vandq_u8(m, vaddq_u8(other_col, one)));
+
+            m = vandq_u8(vandq_u8(is_right, same_row), vcgtq_u8(other_col, col));
+            stop_col = vminq_u8(stop_col, vbslq_u8(m, vsubq_u8(other_col, one), ones));
+        }
+
+        vst1q_u8(stops, vorrq_u8(stop_row, vshlq_n_u8(stop_col, 4)));
+#endif
+
+        // a lane whose stop is where the robot already is can't move
+        for (size_t lane = 0; lane < std::size(stops); ++lane) {
+            size_t const shift = 8 * (lane / 4);
+            if (stops[lane] != static_cast<uint8_t>(raw >> shift)) {
+                uint32_t const child = (raw & ~(0xffu << shift)) | (uint32_t(stops[lane]) << shift);
+                vec.emplace_back(robot_array::from_raw(child),
+                                 {static_cast<color_t>(lane / 4), static_cast<direction_t>(lane % 4)});
+            }
+        }
+        return vec;
+    }
+#endif
+
+    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+        robot const & r = robots.get_robot(color);
+        for (direction_t d : {UP, DOWN, LEFT, RIGHT}) {
+            position const stop = slide(robots, r, d);
+            if (stop != r) {
+                robot_array next = robots;
+                static_cast<position &>(next.get_robot(color)) = stop;
+                vec.emplace_back(next, {color, d});
+            }
+        }
+    }
+
+    return vec;
+}
+
+// Two kinds of successor are dropped. A robot sliding straight back the way it
+// came either ends up where it started, or where sliding that way from parent
+// would have put it, so the state is always reachable in fewer moves. The same
+// robot sliding on the same way again doesn't move, so that never comes up.
+//
+// The other kind is a move of the target robot right after a helper's move that
+// it commutes with, i.e. playing the two the other way round from parent gives
+// the same state. Rather than playing them out, the moves are taken to commute
+// when neither robot is ever on the other's row or column of travel, before or
+// after its move. Only the target robot first order is kept. That is safe even
+// though searches only keep the first way they reach a state: the target robot's
+// move from parent reaches a state on a shortest path too, and the helper's move
+// from there is never dropped. The target robot is told apart from the helpers
+// by canonical() too, so this also holds for states only equal up to that. There
+// is no target robot for rainbow targets, so they only get the first kind
+successors_vec game_state::successors(robot_array const & robots, robot_array const & parent,
+                                      move last_move) const
+{
+    successors_vec next = successors(robots);
+    if (!prune_moves || parent == robots) {
+        return next;
+    }
+
+    // whether a robot going in direction dir along the line through pos ever
+    // meets either of the squares a and b
+    auto on_line = [](position pos, direction_t dir, position a, position b) {
+        return dir == UP || dir == DOWN ? a.col == pos.col || b.col == pos.col
+                                        : a.row == pos.row || b.row == pos.row;
+    };
+
+    bool const helper_moved = target_square.color != RAINBOW &&
+        last_move.robot_color != target_square.color;
+    robot const & helper_before = parent.get_robot(last_move.robot_color);
+    robot const & helper_after = robots.get_robot(last_move.robot_color);
+    next.remove_if([&](successor const & s) {
+        if (s.mv.robot_color == last_move.robot_color) {
+            return s.mv.dir == reverse(last_move.dir);
+        }
+        if (!helper_moved || s.mv.robot_color != target_square.color) {
+            return false;
+        }
+        robot const & target_before = robots.get_robot(s.mv.robot_color);
+        robot const & target_after = s.robots.get_robot(s.mv.robot_color);
+        return !on_line(target_before, s.mv.dir, helper_before, helper_after) &&
+            !on_line(helper_before, last_move.dir, target_before, target_after);
+    });
+    return next;
+}
+
+bool game_state::target_achieved(robot_array const & robots) const
+{
+    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+        robot const & r = robots.get_robot(color);
+        square const & sq = board[r.row][r.col];
+        if (sq.target && *sq.target == target_square &&
+            (sq.target->color == color || sq.target->color == RAINBOW)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The squares with a target_distance of 1 are the ones in line with the target
+// with no wall in between, so that is all the walls have to say. The other
+// robots can still be in the way, or stop the robot on the target when the
+// walls wouldn't, so those candidates get a real slide
+moves_vec game_state::final_moves(robot_array const & robots) const
+{
+    moves_vec moves;
+    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+        if (target_square.color != color && target_square.color != RAINBOW) {
+            continue;
+        }
+        robot const & r = robots.get_robot(color);
+        if (target_distance[r.row][r.col] != 1) {
+            continue;
+        }
+        direction_t const dir = r.row == target_pos.row
+            ? (r.col < target_pos.col ? RIGHT : LEFT)
+            : (r.row < target_pos.row ? DOWN : UP);
+        if (slide(robots, r, dir) == target_pos) {
+            moves.emplace_back(color, dir);
+        }
+    }
+    return moves;
+}
+
+// Only the robot of the target's color matters for reaching the target, the
+// others are interchangeable blockers. States that differ only by a permutation
+// of the blockers are therefore equivalent, so map them all to one key by
+// sorting the blockers. For rainbow targets every robot is a blocker as well as
+// a candidate, so all of them are sorted. The result is only meant to be used
+// as a key: its colors no longer match the real robots
+robot_array game_state::canonical(robot_array const & robots) const
+{
+    auto bytes = std::bit_cast<std::array<uint8_t, k_num_robots>>(robots);
+
+    auto order = [&](size_t a, size_t b) {
+        if (bytes[a] > bytes[b]) {
+            std::swap(bytes[a], bytes[b]);
+        }
+    };
+
+    if (target_square.color == RAINBOW) {
+        // 4 element sorting network
+        order(0, 1);
+        order(2, 3);
+        order(0, 2);
+        order(1, 3);
+        order(1, 2);
+    } else {
+        size_t helpers[k_num_robots - 1];
+        size_t n = 0;
+        for (size_t i = 0; i < k_num_robots; ++i) {
+            if (i != static_cast<size_t>(target_square.color)) {
+                helpers[n++] = i;
+            }
+        }
+        // 3 element sorting network
+        order(helpers[0], helpers[1]);
+        order(helpers[1], helpers[2]);
+        order(helpers[0], helpers[1]);
+    }
+
+    return std::bit_cast<robot_array>(bytes);
+}
+
+static void do_write(int fd, void const * data, size_t size)
+{
+    ssize_t ret = write(fd, data, size);
+    assert(ret == static_cast<ssize_t>(size));
+}
+
+static void do_read(int fd, void * data, size_t size)
+{
+    ssize_t ret = read(fd, data, size);
+    assert(ret == static_cast<ssize_t>(size));
+}
+
+void game_state::save_state(char const * filename, robot_array const & robots)
+{
+    int fd = open(filename, O_RDWR|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR);
+    printf("open: %s\n", strerror(errno));
+    assert(fd != -1);
+
+
+    do_write(fd, &robots, sizeof robots);
+    do_write(fd, &target_square, sizeof target_square);
+
+    uint32_t num_targets = all_targets.size();
     do_write(fd, &num_targets, sizeof num_targets);
     do_write(fd, all_targets.data(), all_targets.size() * sizeof(target));
 
@@ -657,6 +1583,8 @@ robot_array game_state::load_state(char const * filename)
 
     close(fd);
 
+    init_target_distance();
+
     return robots;
 }
 
@@ -752,6 +1680,31 @@ struct solutions
 
     size_t move_count = std::numeric_limits<size_t>::max();
     std::vector<moves_vec> options;
+
+    // how much work the solver did: states whose moves were generated, and the
+    // most states its visited table held
+    size_t states_expanded = 0;
+    size_t peak_visited = 0;
+
+    // fewest moves any solution can take, as far as the solver proved. Same as
+    // move_count when the solutions are known to be the shortest, 0 if the
+    // solver doesn't say
+    size_t lower_bound = 0;
+};
+
+// how long and how big a solver that can stop early may get. No limits by
+// default
+struct solve_budget
+{
+    // true once past the deadline or holding max_visited states. Reading the
+    // clock isn't free, so callers only ask every so often
+    bool exhausted(size_t visited) const
+    {
+        return visited >= max_visited || std::chrono::steady_clock::now() >= deadline;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    size_t max_visited = std::numeric_limits<size_t>::max();
 };
 
 struct state_achived
@@ -760,212 +1713,2538 @@ struct state_achived
     uint8_t moves_used;
 };
 
-struct hash_bucket
+// how the BFS first got to a state: the real robots one move earlier and the
+// move that was played. The start state links to itself
+struct state_link
 {
-    bool used = false;
-    std::pair<robot_array, uint8_t> kv;
+    robot_array parent;
+    move last_move;
 };
 
+// Compare a group of 16 control bytes against b. Returns a mask with one bit
+// per matching slot, slot i at bit i * k_match_stride
+#if defined(__SSE2__)
+
+static constexpr unsigned k_match_stride = 1;
+
+static uint64_t match_group(uint8_t const * ctrl, uint8_t b)
+{
+    __m128i const group = _mm_load_si128(reinterpret_cast<__m128i const *>(ctrl));
+    return static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(b))));
+}
+
+#elif defined(__ARM_NEON)
+
+// no movemask on NEON, narrow each byte of the compare to a nibble instead
+static constexpr unsigned k_match_stride = 4;
+
+static uint64_t match_group(uint8_t const * ctrl, uint8_t b)
+{
+    uint8x16_t const eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(b));
+    uint64_t const nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    return nibbles & 0x8888888888888888ull;
+}
+
+#else
+
+static constexpr unsigned k_match_stride = 1;
+
+static uint64_t match_group(uint8_t const * ctrl, uint8_t b)
+{
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < 16; ++i) {
+        mask |= uint64_t(ctrl[i] == b) << i;
+    }
+    return mask;
+}
+
+#endif
+
+// Visited table for the BFS, laid out like a swiss table. Slots come in groups
+// of 16 with one control byte each: k_empty, or the low 7 bits of the key's
+// hash. A probe compares a whole group of control bytes at once and only looks
+// at keys whose bits match. Keys are packed robot_arrays kept in their own
+// array, 0 can't be a real state (all robots on one square) so it marks an
+// empty key. Values are kept in a third array. Nothing is ever erased, so there
+// are no tombstones, and the table grows at 7/8 full.
+//
+// Growing doesn't stop the world. A new table twice the size is allocated and
+// the old one stays live, read only, while each emplace moves a few of its
+// groups across. Lookups check the new table and then the old one.
 struct states_map
 {
-    using iterator = std::pair<robot_array, uint8_t> *;
+    struct iterator
+    {
+        uint32_t const * key;
+        state_link * value;
+    };
 
-    std::pair<iterator, bool> emplace(robot_array const & robots, uint8_t moves_used)
+    static constexpr uint32_t k_empty_key = 0;
+    static constexpr uint8_t k_empty = 0x80;
+    static constexpr size_t k_group_size = 16;
+
+    // old groups moved to the new table on each emplace while growing
+    static constexpr size_t k_migrate_groups = 4;
+
+    states_map()
+    {
+        current.allocate(4096);
+    }
+
+    std::pair<iterator, bool> emplace(robot_array const & robots, state_link const & link)
     {
         ++probes;
 
+        if (old.size) {
+            migrate(k_migrate_groups);
+        }
+        if (count >= current.limit) {
+            start_resize(current.size * 2);
+        }
+
         uint32_t const raw = robots.raw();
-        uint32_t const hash = ::hash((unsigned char *)&raw, 4);
-        for (uint32_t index = hash & mask; ; index = (index + 1) & mask) {
-            hash_bucket & bucket = buckets[index];
-            if (bucket.used) {
-                if (bucket.kv.first.raw() == raw) {
+        assert(raw != k_empty_key);
+        uint32_t const hash = ::hash(raw);
+        uint8_t const tag = hash & 0x7f;
+        size_t length = 1;
+        for (size_t group = (hash >> 7) & current.group_mask; ; group = (group + 1) & current.group_mask, ++length) {
+            uint8_t * const ctrl = current.groups[group].ctrl;
+            size_t const base = group * k_group_size;
+            for (uint64_t m = match_group(ctrl, tag); m; m &= m - 1) {
+                size_t const index = base + std::countr_zero(m) / k_match_stride;
+                if (current.keys[index] == raw) {
                     // found
-                    return {&bucket.kv, false};
+                    record_probe_length(length);
+                    return {{&current.keys[index], &current.values[index]}, false};
                 }
-                // hash collision, keep trying
+                // tag collision
                 ++collisions;
-            } else {
+            }
+
+            if (uint64_t m = match_group(ctrl, k_empty)) {
+                // not in the new table. Anything in the old table that hasn't
+                // been moved yet is still there
+                record_probe_length(length);
+                if (old.size) {
+                    if (std::optional<size_t> index = old.find(raw, hash)) {
+                        return {{&old.keys[*index], &old.values[*index]}, false};
+                    }
+                }
 
-                // not found
-                bucket.used = true;
-                bucket.kv.first = robots;
-                bucket.kv.second = moves_used;
+                size_t const index = base + std::countr_zero(m) / k_match_stride;
+                ctrl[index - base] = tag;
+                current.keys[index] = raw;
+                current.values[index] = link;
                 ++count;
+                return {{&current.keys[index], &current.values[index]}, true};
+            }
+        }
+    }
 
-                if (count < limit) {
-                    return {&bucket.kv, true};
-                }
-                break;
+    state_link const * find(robot_array const & robots) const
+    {
+        uint32_t const raw = robots.raw();
+        uint32_t const hash = ::hash(raw);
+        if (std::optional<size_t> index = current.find(raw, hash)) {
+            return &current.values[*index];
+        }
+        if (old.size) {
+            if (std::optional<size_t> index = old.find(raw, hash)) {
+                return &old.values[*index];
             }
-            //printf("search index %u raw 0x%x\n", index, raw);
         }
+        return nullptr;
+    }
 
-        return grow(robots);
+    // make room for at least n states, e.g. what the next BFS layer is expected
+    // to add. The table is resized incrementally as usual, just sooner
+    void reserve(size_t n)
+    {
+        if (n > current.limit) {
+            start_resize(std::bit_ceil(n + n / 7 + k_group_size));
+        }
     }
 
-    __attribute__((noinline))
-    std::pair<iterator, bool> grow(robot_array const & robots);
+    // bucket i counts emplace calls that looked at [2^i, 2^(i+1)) groups of the
+    // new table
+    static constexpr size_t k_probe_histogram_size = 16;
+
+    void record_probe_length(size_t length)
+    {
+        ++probe_histogram[std::min<size_t>(std::bit_width(length) - 1, k_probe_histogram_size - 1)];
+    }
 
     size_t probes = 0;
     size_t collisions = 0;
+    size_t probe_histogram[k_probe_histogram_size] = {};
 
-    size_t size = 4096;
-    size_t mask = size - 1;
+    // states in both tables
     size_t count = 0;
-    size_t limit = size/4;
-    std::unique_ptr<hash_bucket[]> buckets = std::make_unique<hash_bucket[]>(size);
+
+private:
+    struct alignas(k_group_size) group
+    {
+        uint8_t ctrl[k_group_size];
+    };
+
+    struct table
+    {
+        void allocate(size_t new_size)
+        {
+            assert(std::has_single_bit(new_size) && new_size >= k_group_size);
+            size = new_size;
+            group_mask = size / k_group_size - 1;
+            limit = size / 8 * 7;
+            groups = std::make_unique<group[]>(size / k_group_size);
+            keys = std::make_unique<uint32_t[]>(size);
+            values = std::make_unique<state_link[]>(size);
+            for (size_t g = 0; g < size / k_group_size; ++g) {
+                std::fill_n(groups[g].ctrl, k_group_size, k_empty);
+            }
+        }
+
+        std::optional<size_t> find(uint32_t raw, uint32_t hash) const
+        {
+            uint8_t const tag = hash & 0x7f;
+            for (size_t group = (hash >> 7) & group_mask; ; group = (group + 1) & group_mask) {
+                uint8_t const * const ctrl = groups[group].ctrl;
+                size_t const base = group * k_group_size;
+                for (uint64_t m = match_group(ctrl, tag); m; m &= m - 1) {
+                    size_t const index = base + std::countr_zero(m) / k_match_stride;
+                    if (keys[index] == raw) {
+                        return index;
+                    }
+                }
+                if (match_group(ctrl, k_empty)) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        // for keys known not to be in the table
+        void insert_new(uint32_t raw, state_link const & link)
+        {
+            uint32_t const hash = ::hash(raw);
+            for (size_t group = (hash >> 7) & group_mask; ; group = (group + 1) & group_mask) {
+                if (uint64_t m = match_group(groups[group].ctrl, k_empty)) {
+                    size_t const lane = std::countr_zero(m) / k_match_stride;
+                    size_t const index = group * k_group_size + lane;
+                    groups[group].ctrl[lane] = hash & 0x7f;
+                    keys[index] = raw;
+                    values[index] = link;
+                    return;
+                }
+            }
+        }
+
+        void release()
+        {
+            size = 0;
+            groups.reset();
+            keys.reset();
+            values.reset();
+        }
+
+        size_t size = 0;
+        size_t group_mask = 0;
+        size_t limit = 0;
+        std::unique_ptr<group[]> groups;
+        std::unique_ptr<uint32_t[]> keys;
+        std::unique_ptr<state_link[]> values;
+    };
+
+    __attribute__((noinline))
+    void start_resize(size_t new_size);
+
+    void migrate(size_t num_groups);
+
+    table current;
+    // the table being moved out of while growing, size 0 otherwise
+    table old;
+    // first group of old that hasn't been moved yet
+    size_t migrated_groups = 0;
 };
 
 __attribute__((noinline))
-std::pair<states_map::iterator, bool> states_map::grow(robot_array const & robots)
+void states_map::start_resize(size_t new_size)
 {
-    printf("grow\n");
+    if (old.size) {
+        // still moving out of the last table, finish that first. Only happens
+        // when reserve() asks for more than a doubling
+        migrate(old.size / k_group_size);
+    }
 
-    size_t old_size = size;
-    size_t new_size = size * 2;
-    assert(std::has_single_bit(new_size));
-    std::unique_ptr<hash_bucket[]> new_buckets = std::make_unique<hash_bucket[]>(new_size);
-    std::swap(buckets, new_buckets);
-    size = new_size;
-    mask = new_size - 1;
-    count = 0;
-    limit = new_size/4;
+    old = std::move(current);
+    migrated_groups = 0;
+    current.allocate(std::max(new_size, old.size * 2));
+}
 
-    std::optional<std::pair<iterator, bool>> ret;
-    for (hash_bucket * b = new_buckets.get(); b < new_buckets.get() + old_size; ++b) {
-        if (b->used) {
-            auto tmp = emplace(b->kv.first, b->kv.second);
-            if (b->kv.first == robots) {
-                assert(!ret);
-                ret = tmp;
+void states_map::migrate(size_t num_groups)
+{
+    size_t const end = std::min(migrated_groups + num_groups, old.size / k_group_size);
+    for (; migrated_groups < end; ++migrated_groups) {
+        size_t const base = migrated_groups * k_group_size;
+        for (size_t i = base; i < base + k_group_size; ++i) {
+            if (old.keys[i] != k_empty_key) {
+                current.insert_new(old.keys[i], old.values[i]);
             }
         }
     }
-    return ret.value();
+
+    if (migrated_groups == old.size / k_group_size) {
+        old.release();
+    }
 }
 
-static solutions solve_bfs(game_state const & game, robot_array const & robots)
+// hardware counters for the calling thread, read as a group so that they all
+// cover the same interval. Only available on Linux, and only if the kernel lets
+// us at them (perf_event_paranoid), otherwise available() is false
+struct perf_counters
 {
-    solutions sols;
-    if (game.target_achieved(robots)) {
-        // degenerate solution
-        sols.move_count = 0;
-        sols.options.emplace_back();
+    static constexpr size_t k_num_counters = 4;
+    static constexpr char const * k_names[k_num_counters] = {
+        "cycles", "instructions", "cache_misses", "branch_misses",
+    };
 
-        return sols;
+    using values = std::array<uint64_t, k_num_counters>;
+
+    perf_counters()
+    {
+#ifdef __linux__
+        static constexpr uint64_t configs[k_num_counters] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        for (size_t i = 0; i < k_num_counters; ++i) {
+            perf_event_attr attr{};
+            attr.size = sizeof attr;
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            int const group = i == 0 ? -1 : fds[0];
+            fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+            if (fds[i] == -1) {
+                close_all();
+                return;
+            }
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
     }
 
-    states_map states_achieved;
-    //std::unordered_map<robot_array, uint8_t> states_achieved;
-    states_achieved.emplace(robots, 0);
-    std::vector<std::pair<robot_array, moves_vec>> states_to_explore{{robots, {}}};
-    std::vector<std::pair<robot_array, moves_vec>> next_states;
+    perf_counters(perf_counters const &) = delete;
+    perf_counters & operator=(perf_counters const &) = delete;
 
-    size_t moves_used = 0;
-    while (sols.options.empty()) {
-        ++moves_used;
+    ~perf_counters()
+    {
+        close_all();
+    }
 
-        assert(!states_to_explore.empty());
-        size_t num_moves = 0;
-        size_t new_states = 0;
-        for (auto const & [current_robots, moves] : states_to_explore) {
-            for (move mv : game.valid_moves(current_robots)) {
-                ++num_moves;
-                robot_array next_robots = game.play(current_robots, mv);
+    bool available() const
+    {
+        return fds[0] != -1;
+    }
 
-                if (game.target_achieved(next_robots)) {
-                    sols.add(moves + mv);
+    values read() const
+    {
+        values v{};
+#ifdef __linux__
+        if (available()) {
+            uint64_t buf[1 + k_num_counters];
+            do_read(fds[0], buf, sizeof buf);
+            assert(buf[0] == k_num_counters);
+            std::copy_n(buf + 1, k_num_counters, v.begin());
+        }
+#endif
+        return v;
+    }
 
-                    printf("solution of size %zu found\n", sols.options.back().size());
-                } else if (sols.options.empty()) {
-                    auto [it, did_insert] = states_achieved.emplace(next_robots, moves_used);
-                    if (did_insert || it->second > moves_used) {
-                        ++new_states;
-                        moves_vec next_moves = moves + mv;
-                        it->second = moves_used;
-                        next_states.emplace_back(next_robots, next_moves);
-                    }
-                }
+private:
+    void close_all()
+    {
+        for (int & fd : fds) {
+            if (fd != -1) {
+                close(fd);
+                fd = -1;
             }
         }
-
-        printf("explored %zu states, %zu moves, %zu new states found\n",
-               states_to_explore.size(), num_moves, new_states);
-
-        std::swap(states_to_explore, next_states);
-        next_states.clear();
     }
 
-    printf("%zu probes, %zu collisions\n", states_achieved.probes, states_achieved.collisions);
-
-    return sols;
-}
+    int fds[k_num_counters] = {-1, -1, -1, -1};
+};
 
-static void do_solve_dfs(game_state const & game, robot_array const & robots,
-                         std::unordered_map<robot_array, size_t> & states_achieved,
-                         moves_vec const & current_moves, solutions & sols)
+// what the BFS records about itself when SOLVER_STATS is set. With
+// SOLVER_STATS=perf it also splits each layer into separate passes for the
+// phases below and reads the hardware counters between them
+struct bfs_stats
 {
-    // can't improve down this route.
-    if (current_moves.size() == sols.move_count) {
-        return;
-    }
-
-    // probably too deep?
-    if (current_moves.size() > 15) {
-        return;
-    }
+    enum phase
+    {
+        MOVE_GENERATION,
+        GOAL_TEST,
+        DEDUPE,
+        FRONTIER_PUSH,
+        NUM_PHASES,
+    };
 
-    assert(current_moves.size() < sols.move_count);
+    static constexpr char const * k_phase_names[NUM_PHASES] = {
+        "move_generation", "goal_test", "dedupe", "frontier_push",
+    };
 
-    moves_vec moves = game.valid_moves(robots);
+    struct layer
+    {
+        size_t frontier = 0;
+        size_t moves = 0;
+        size_t new_states = 0;
+        double us = 0;
+        size_t probe_histogram[states_map::k_probe_histogram_size] = {};
+    };
 
-    bool solution_found = false;
-    for (move mv : moves) {
-        robot_array next_robots = game.play(robots, mv);
-        if (game.target_achieved(next_robots)) {
-            sols.add(current_moves + mv);
-            solution_found = true;
-            //printf("solution of size %zu found\n", solution.size());
+    // returns nullptr if stats are off
+    static std::unique_ptr<bfs_stats> from_env()
+    {
+        char const * env = getenv("SOLVER_STATS");
+        if (!env || strcmp(env, "0") == 0) {
+            return nullptr;
         }
+        auto stats = std::make_unique<bfs_stats>();
+        if (strcmp(env, "perf") == 0) {
+            stats->counters = std::make_unique<perf_counters>();
+        }
+        return stats;
     }
 
-    if (solution_found) {
-        return;
+    bool phased() const
+    {
+        return counters != nullptr;
     }
 
-    for (move mv : moves) {
-        robot_array next_robots = game.play(robots, mv);
-        size_t moves_used = current_moves.size() + 1;
-        auto [it, did_insert] = states_achieved.emplace(next_robots, moves_used);
-        if (did_insert || it->second > moves_used) {
-            it->second = moves_used;
-            do_solve_dfs(game, next_robots, states_achieved, current_moves + mv, sols);
+    // called between phases, charges everything since the last call to p
+    void end_phase(phase p)
+    {
+        perf_counters::values const now = counters->read();
+        for (size_t i = 0; i < perf_counters::k_num_counters; ++i) {
+            phase_totals[p][i] += now[i] - last[i];
         }
+        last = now;
     }
-}
 
-static solutions solve_dfs(game_state const & game, robot_array const & robots)
-{
-    std::unordered_map<robot_array, size_t> states_achieved;
-    states_achieved.emplace(robots, 0);
+    void start_phases()
+    {
+        last = counters->read();
+    }
 
-    solutions sols;
+    void print(FILE * out) const
+    {
+        fprintf(out, "{\"solver\": \"bfs\", \"layers\": [");
+        for (size_t i = 0; i < layers.size(); ++i) {
+            layer const & l = layers[i];
+            fprintf(out, "%s{\"depth\": %zu, \"frontier\": %zu, \"moves\": %zu, "
+                    "\"new_states\": %zu, \"us\": %.1f, \"probe_histogram\": [",
+                    i ? ", " : "", i + 1, l.frontier, l.moves, l.new_states, l.us);
+            for (size_t b = 0; b < std::size(l.probe_histogram); ++b) {
+                fprintf(out, "%s%zu", b ? ", " : "", l.probe_histogram[b]);
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "]");
+
+        if (counters) {
+            fprintf(out, ", \"perf_available\": %s", counters->available() ? "true" : "false");
+        }
+        if (counters && counters->available()) {
+            fprintf(out, ", \"phases\": {");
+            for (size_t p = 0; p < NUM_PHASES; ++p) {
+                fprintf(out, "%s\"%s\": {", p ? ", " : "", k_phase_names[p]);
+                for (size_t i = 0; i < perf_counters::k_num_counters; ++i) {
+                    fprintf(out, "%s\"%s\": %llu", i ? ", " : "", perf_counters::k_names[i],
+                            static_cast<unsigned long long>(phase_totals[p][i]));
+                }
+                fprintf(out, "}");
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}\n");
+    }
+
+    std::vector<layer> layers;
+    std::unique_ptr<perf_counters> counters;
+    perf_counters::values last{};
+    perf_counters::values phase_totals[NUM_PHASES] = {};
+};
+
+// walk the links in a visited table back from a state that was reached in
+// depth moves to rebuild the moves that got there. key maps a state to the key
+// it was stored under
+template <typename Map, typename Key>
+static moves_vec trace_moves(Map const & states, robot_array robots, size_t depth, Key key)
+{
+    move path[32];
+    assert(depth <= std::size(path));
+    for (size_t i = depth; i-- > 0; ) {
+        state_link const * link = states.find(key(robots));
+        assert(link);
+        path[i] = link->last_move;
+        robots = link->parent;
+    }
+
+    moves_vec moves;
+    for (size_t i = 0; i < depth; ++i) {
+        moves.emplace_back(path[i]);
+    }
+    return moves;
+}
+
+template <typename Map>
+static moves_vec trace_moves(game_state const & game, Map const & states,
+                             robot_array robots, size_t depth)
+{
+    return trace_moves(states, robots, depth, [&](robot_array const & r) {
+        return game.canonical(r);
+    });
+}
+
+// If the budget runs out first, returns no solutions, but with the lower bound
+// set to the shortest solution length not ruled out yet
+static solutions solve_bfs(game_state const & game, robot_array const & robots,
+                           solve_budget const & budget)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    states_map states_achieved;
+    //std::unordered_map<robot_array, uint8_t> states_achieved;
+    states_achieved.emplace(game.canonical(robots), {robots, {}});
+    // states are deduplicated by their canonical key, but the frontier keeps the
+    // real robots so that the links in states_achieved record real moves. The
+    // moves themselves are only rebuilt once the solutions are found
+    std::vector<robot_array> states_to_explore{robots};
+    std::vector<robot_array> next_states;
+    // how each frontier state was first reached, the same as its link in
+    // states_achieved, which is what successors() prunes by
+    std::vector<state_link> links_to_explore{{robots, {}}};
+    std::vector<state_link> next_links;
+    // states one move short of the target, and the move that finishes
+    std::vector<std::pair<robot_array, move>> solved;
+
+    std::unique_ptr<bfs_stats> stats = bfs_stats::from_env();
+    // children of the layer, only used when running the phases separately
+    struct child
+    {
+        robot_array parent;
+        move mv;
+        robot_array robots;
+        bool is_new;
+    };
+    std::vector<child> children;
+
+    // new states per explored state in the last layer, used to size the table
+    // ahead of each layer. Every robot can go 4 ways from the start
+    double growth = k_num_robots * 4;
+
+    size_t moves_used = 0;
+    // what to return once the budget runs out, after expanding expanded states
+    // of a layer with no solution in moves_used moves. The final moves already
+    // ruled that out
+    auto out_of_budget = [&](size_t expanded) {
+        solutions partial;
+        partial.states_expanded = sols.states_expanded + expanded;
+        partial.peak_visited = states_achieved.count;
+        partial.lower_bound = moves_used + 1;
+        return partial;
+    };
+    while (solved.empty()) {
+        ++moves_used;
+
+        assert(!states_to_explore.empty());
+        if (stop_requested()) {
+            return {};
+        }
+        // no bigger than the budget lets the table get, which the checks below
+        // only notice every so often
+        size_t const expected = states_achieved.count + states_to_explore.size() * growth;
+        states_achieved.reserve(std::min(expected, budget.max_visited));
+        size_t num_moves = 0;
+        size_t new_states = 0;
+        auto layer_start = std::chrono::steady_clock::now();
+        bfs_stats::layer layer_before;
+        std::copy_n(states_achieved.probe_histogram, std::size(layer_before.probe_histogram),
+                    layer_before.probe_histogram);
+
+        // solutions of this length are found from the states one move short
+        // of it, so the last layer's children are never generated. That also
+        // means no child found below can be on the target
+        if (stats && stats->phased()) {
+            stats->start_phases();
+        }
+        for (robot_array const & current_robots : states_to_explore) {
+            for (move const & mv : game.final_moves(current_robots)) {
+                solved.emplace_back(current_robots, mv);
+
+                solver_printf("solution of size %zu found\n", moves_used);
+            }
+        }
+
+        if (!solved.empty()) {
+            if (stats && stats->phased()) {
+                stats->end_phase(bfs_stats::GOAL_TEST);
+            }
+        } else if (stats && stats->phased()) {
+            // same as below, but one pass per phase so the counters can tell
+            // them apart
+            stats->end_phase(bfs_stats::GOAL_TEST);
+            if (budget.exhausted(states_achieved.count)) {
+                return out_of_budget(0);
+            }
+
+            children.clear();
+            for (size_t i = 0; i < states_to_explore.size(); ++i) {
+                robot_array const & current_robots = states_to_explore[i];
+                state_link const & link = links_to_explore[i];
+                for (auto const & [next_robots, mv] : game.successors(current_robots, link.parent,
+                                                                      link.last_move)) {
+                    children.push_back({current_robots, mv, next_robots, false});
+                }
+            }
+            num_moves = children.size();
+            stats->end_phase(bfs_stats::MOVE_GENERATION);
+
+            for (size_t i = 0; i < children.size(); ++i) {
+                child & c = children[i];
+                if (i % 256 == 255 && budget.exhausted(states_achieved.count)) {
+                    return out_of_budget(states_to_explore.size());
+                }
+                c.is_new = states_achieved.emplace(game.canonical(c.robots),
+                                                   {c.parent, c.mv}).second;
+            }
+            stats->end_phase(bfs_stats::DEDUPE);
+
+            for (child const & c : children) {
+                if (c.is_new) {
+                    ++new_states;
+                    next_states.push_back(c.robots);
+                    next_links.push_back({c.parent, c.mv});
+                }
+            }
+            stats->end_phase(bfs_stats::FRONTIER_PUSH);
+        } else {
+            size_t expanded = 0;
+            for (size_t i = 0; i < states_to_explore.size(); ++i) {
+                robot_array const & current_robots = states_to_explore[i];
+                state_link const & link = links_to_explore[i];
+                if (stop_requested()) {
+                    return {};
+                }
+                if (++expanded % 256 == 0 && budget.exhausted(states_achieved.count)) {
+                    return out_of_budget(expanded);
+                }
+                for (auto const & [next_robots, mv] : game.successors(current_robots, link.parent,
+                                                                      link.last_move)) {
+                    ++num_moves;
+
+                    auto [it, did_insert] = states_achieved.emplace(game.canonical(next_robots),
+                                                                    {current_robots, mv});
+                    if (did_insert) {
+                        ++new_states;
+                        next_states.push_back(next_robots);
+                        next_links.push_back({current_robots, mv});
+                    }
+                }
+            }
+        }
+
+        solver_printf("explored %zu states, %zu moves, %zu new states found\n",
+                      states_to_explore.size(), num_moves, new_states);
+        sols.states_expanded += states_to_explore.size();
+        growth = double(new_states) / states_to_explore.size();
+
+        if (stats) {
+            bfs_stats::layer & l = stats->layers.emplace_back();
+            l.frontier = states_to_explore.size();
+            l.moves = num_moves;
+            l.new_states = new_states;
+            l.us = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - layer_start).count();
+            for (size_t b = 0; b < std::size(l.probe_histogram); ++b) {
+                l.probe_histogram[b] = states_achieved.probe_histogram[b] -
+                    layer_before.probe_histogram[b];
+            }
+        }
+
+        std::swap(states_to_explore, next_states);
+        next_states.clear();
+        std::swap(links_to_explore, next_links);
+        next_links.clear();
+    }
+
+    solver_printf("%zu probes, %zu collisions\n", states_achieved.probes, states_achieved.collisions);
+    sols.peak_visited = states_achieved.count;
+
+    if (stats) {
+        stats->print(stderr);
+    }
+
+    for (auto const & [parent, mv] : solved) {
+        sols.add(trace_moves(game, states_achieved, parent, moves_used - 1) + mv);
+    }
+    sols.lower_bound = sols.move_count;
+
+    return sols;
+}
+
+static solutions solve_bfs(game_state const & game, robot_array const & robots)
+{
+    return solve_bfs(game, robots, solve_budget{});
+}
+
+// visited set shared by the parallel BFS workers. Slots are claimed with a CAS
+// on the packed robot_array. A raw value of 0 would mean all robots on the same
+// square, which can't happen, so it marks an empty slot. The table never grows
+// while workers are running: reserve() is only called between their runs, and
+// the workers stop before the states they may add could fill it
+struct concurrent_states_set
+{
+    static constexpr uint32_t k_empty = 0;
+
+    // returns true if the state was not in the set before. Only the thread that
+    // inserts a state writes its link, and links are only read once all the
+    // workers are done
+    bool insert(robot_array const & robots, state_link const & link)
+    {
+        uint32_t const raw = robots.raw();
+        assert(raw != k_empty);
+        uint32_t const hash = ::hash(raw);
+        for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+            std::atomic<uint32_t> & slot = slots[index];
+            uint32_t current = slot.load(std::memory_order_relaxed);
+            if (current == k_empty) {
+                if (slot.compare_exchange_strong(current, raw, std::memory_order_relaxed)) {
+                    links[index] = link;
+                    return true;
+                }
+                // lost the race for this slot, current now holds the winner
+            }
+            if (current == raw) {
+                return false;
+            }
+        }
+    }
+
+    // single threaded
+    state_link const * find(robot_array const & robots) const
+    {
+        uint32_t const raw = robots.raw();
+        uint32_t const hash = ::hash(raw);
+        for (size_t index = hash & mask; ; index = (index + 1) & mask) {
+            uint32_t current = slots[index].load(std::memory_order_relaxed);
+            if (current == raw) {
+                return &links[index];
+            }
+            if (current == k_empty) {
+                return nullptr;
+            }
+        }
+    }
+
+    // single threaded. Make sure count + extra states fit at 1/2 load
+    void reserve(size_t extra)
+    {
+        size_t needed = 2 * (count + extra);
+        if (needed <= size) {
+            return;
+        }
+
+        size_t const old_size = size;
+        size = std::bit_ceil(needed);
+        mask = size - 1;
+        std::unique_ptr<std::atomic<uint32_t>[]> old_slots = std::move(slots);
+        std::unique_ptr<state_link[]> old_links = std::move(links);
+        slots = std::make_unique<std::atomic<uint32_t>[]>(size);
+        links = std::make_unique<state_link[]>(size);
+        for (size_t i = 0; i < old_size; ++i) {
+            uint32_t raw = old_slots[i].load(std::memory_order_relaxed);
+            if (raw != k_empty) {
+                size_t index = ::hash(raw) & mask;
+                while (slots[index].load(std::memory_order_relaxed) != k_empty) {
+                    index = (index + 1) & mask;
+                }
+                slots[index].store(raw, std::memory_order_relaxed);
+                links[index] = old_links[i];
+            }
+        }
+    }
+
+    size_t size = 0;
+    size_t mask = 0;
+    size_t count = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> slots;
+    std::unique_ptr<state_link[]> links;
+};
+
+// level-synchronous BFS: each layer is split into chunks that the workers pull
+// from a shared counter. Each worker builds its own slice of the next layer and
+// its own solutions, and those are merged once every worker is done
+static solutions solve_bfs_parallel(game_state const & game, robot_array const & robots,
+                                    unsigned num_threads, solve_budget const & budget)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    using frontier = std::vector<robot_array>;
+
+    struct worker_state
+    {
+        frontier next_states;
+        std::vector<std::pair<robot_array, move>> solved;
+        size_t num_moves = 0;
+    };
+
+    static constexpr size_t k_chunk_size = 256;
+    // most new states a chunk can add, every state has at most 16 children
+    static constexpr size_t k_chunk_states = k_chunk_size * k_num_robots * 4;
+
+    concurrent_states_set states_achieved;
+    states_achieved.reserve(1);
+    states_achieved.insert(game.canonical(robots), {robots, {}});
+    states_achieved.count = 1;
+
+    frontier states_to_explore{robots};
+    std::vector<worker_state> workers(num_threads);
+    std::vector<std::pair<robot_array, move>> solved;
+
+    // new states per explored state in the last layer, used to size the table
+    // ahead of each layer. Every robot can go 4 ways from the start
+    double growth = k_num_robots * 4;
+
+    size_t moves_used = 0;
+    while (solved.empty()) {
+        ++moves_used;
+        assert(!states_to_explore.empty());
+        if (stop_requested()) {
+            return {};
+        }
+
+        std::atomic<size_t> next_chunk = 0;
+        // set once any worker finds a solution, after which the workers only
+        // look for other solutions of the same length
+        std::atomic<bool> layer_solved = false;
+        // new states found so far in this layer, added a chunk at a time
+        std::atomic<size_t> layer_new = 0;
+        // how many states the table can take before it gets too full. A
+        // worker only takes a chunk if every worker's chunk could still fit
+        size_t room = 0;
+        size_t const headroom = num_threads * k_chunk_states;
+        // the workers don't share this thread's solver_stop
+        std::atomic<bool> const * const stop = solver_stop;
+        auto work = [&](worker_state & w) {
+            while (true) {
+                if (states_achieved.count + layer_new.load(std::memory_order_relaxed) + headroom > room) {
+                    break;
+                }
+                size_t const begin = next_chunk.fetch_add(k_chunk_size, std::memory_order_relaxed);
+                if (begin >= states_to_explore.size() ||
+                    (stop && stop->load(std::memory_order_relaxed))) {
+                    break;
+                }
+                size_t const end = std::min(begin + k_chunk_size, states_to_explore.size());
+                size_t chunk_new = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    robot_array const & current_robots = states_to_explore[i];
+                    for (move const & mv : game.final_moves(current_robots)) {
+                        w.solved.emplace_back(current_robots, mv);
+                        layer_solved.store(true, std::memory_order_relaxed);
+                    }
+                    if (layer_solved.load(std::memory_order_relaxed)) {
+                        continue;
+                    }
+
+                    for (auto const & [next_robots, mv] : game.successors(current_robots)) {
+                        ++w.num_moves;
+
+                        if (states_achieved.insert(game.canonical(next_robots),
+                                                   {current_robots, mv})) {
+                            w.next_states.push_back(next_robots);
+                            ++chunk_new;
+                        }
+                    }
+                }
+                layer_new.fetch_add(chunk_new, std::memory_order_relaxed);
+            }
+        };
+
+        // Size the table for the growth seen so far, from the last layer to
+        // start with and then from this one, rather than for the worst case.
+        // If the workers run out of room the table grows and they carry on
+        // from the next chunk
+        while (true) {
+            size_t const done = std::min(next_chunk.load(std::memory_order_relaxed),
+                                         states_to_explore.size());
+            size_t const left = states_to_explore.size() - done;
+            if (left == 0) {
+                break;
+            }
+            size_t const found = layer_new.load(std::memory_order_relaxed);
+            double const rate = done ? double(found) / done : growth;
+            size_t extra = found + std::min<size_t>(std::ceil(left * rate), left * k_num_robots * 4);
+            // no more than the budget lets the table hold, as long as that
+            // leaves room for the workers to get anywhere
+            if (budget.max_visited != std::numeric_limits<size_t>::max()) {
+                size_t const allowed = budget.max_visited > states_achieved.count
+                    ? budget.max_visited - states_achieved.count : 0;
+                extra = std::min(extra, allowed);
+            }
+            states_achieved.reserve(std::max(extra, found) + headroom);
+            room = states_achieved.size / 4 * 3;
+
+            // no point starting threads that won't get a chunk
+            size_t const num_chunks = (left + k_chunk_size - 1) / k_chunk_size;
+            size_t const threads_used = std::min<size_t>(num_threads, num_chunks);
+            std::vector<std::thread> threads;
+            for (size_t i = 1; i < threads_used; ++i) {
+                threads.emplace_back(work, std::ref(workers[i]));
+            }
+            work(workers[0]);
+            for (std::thread & t : threads) {
+                t.join();
+            }
+            if (stop_requested()) {
+                return {};
+            }
+            if (budget.exhausted(states_achieved.count + layer_new.load(std::memory_order_relaxed))) {
+                // no solution in moves_used moves, the final moves already
+                // ruled that out
+                solutions partial;
+                partial.states_expanded = sols.states_expanded +
+                    std::min(next_chunk.load(std::memory_order_relaxed), states_to_explore.size());
+                partial.peak_visited = states_achieved.count + layer_new.load(std::memory_order_relaxed);
+                partial.lower_bound = moves_used + 1;
+                return partial;
+            }
+        }
+
+        // layer barrier: merge the workers' results
+        size_t num_moves = 0;
+        size_t new_states = 0;
+        for (worker_state & w : workers) {
+            num_moves += w.num_moves;
+            new_states += w.next_states.size();
+            solved.insert(solved.end(), w.solved.begin(), w.solved.end());
+            w.num_moves = 0;
+            w.solved.clear();
+        }
+        states_achieved.count += new_states;
+
+        solver_printf("explored %zu states, %zu moves, %zu new states found\n",
+                      states_to_explore.size(), num_moves, new_states);
+        sols.states_expanded += states_to_explore.size();
+        growth = double(new_states) / states_to_explore.size();
+
+        states_to_explore.clear();
+        if (solved.empty()) {
+            for (worker_state & w : workers) {
+                states_to_explore.insert(states_to_explore.end(),
+                                         w.next_states.begin(), w.next_states.end());
+                w.next_states.clear();
+            }
+        }
+    }
+
+    solver_printf("%zu states in %zu slots\n", states_achieved.count, states_achieved.size);
+    sols.peak_visited = states_achieved.count;
+
+    for (auto const & [parent, mv] : solved) {
+        sols.add(trace_moves(game, states_achieved, parent, moves_used - 1) + mv);
+    }
+    sols.lower_bound = sols.move_count;
+
+    return sols;
+}
+
+// visited set with one bit for every possible packed robot_array, 512 MiB of
+// address space. Pages are only backed once a state on them is visited, and we
+// ask for huge pages so that the random accesses don't thrash the TLB. Mapping
+// and faulting that in costs more than an easy solve, so sets are kept for
+// later solves and only the bits that were set get cleared
+struct dense_states_set
+{
+    static constexpr size_t k_bytes = (size_t(1) << 32) / 8;
+
+    dense_states_set()
+    {
+        int const prot = PROT_READ | PROT_WRITE;
+        int const flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        void * mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        // no MAP_NORESERVE here: this has to fail up front rather than fault
+        // later if there aren't enough huge pages in the pool
+        mem = mmap(nullptr, k_bytes, prot, flags | MAP_HUGETLB, -1, 0);
+#endif
+        if (mem == MAP_FAILED) {
+            // no huge pages reserved, fall back to normal pages
+            mem = mmap(nullptr, k_bytes, prot, flags | MAP_NORESERVE, -1, 0);
+            assert(mem != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+            madvise(mem, k_bytes, MADV_HUGEPAGE);
+#endif
+        }
+        words = static_cast<uint64_t *>(mem);
+    }
+
+    dense_states_set(dense_states_set const &) = delete;
+    dense_states_set & operator=(dense_states_set const &) = delete;
+
+    ~dense_states_set()
+    {
+        munmap(words, k_bytes);
+    }
+
+    // an empty set no other search is using
+    static std::unique_ptr<dense_states_set> acquire()
+    {
+        std::lock_guard<std::mutex> lock(spare_mutex);
+        if (spare.empty()) {
+            return std::make_unique<dense_states_set>();
+        }
+        std::unique_ptr<dense_states_set> set = std::move(spare.back());
+        spare.pop_back();
+        return set;
+    }
+
+    // hand back a set once everything in it has been erased
+    static void release(std::unique_ptr<dense_states_set> set)
+    {
+        assert(set->count == 0);
+        std::lock_guard<std::mutex> lock(spare_mutex);
+        spare.push_back(std::move(set));
+    }
+
+    // returns true if the state was not in the set before
+    bool insert(robot_array const & robots)
+    {
+        uint32_t const raw = robots.raw();
+        uint64_t & word = words[raw >> 6];
+        uint64_t const bit = uint64_t(1) << (raw & 63);
+        bool const inserted = !(word & bit);
+        word |= bit;
+        count += inserted;
+        return inserted;
+    }
+
+    // remove raw keys that are in the set
+    void erase(std::vector<uint32_t> const & keys)
+    {
+        for (uint32_t raw : keys) {
+            words[raw >> 6] &= ~(uint64_t(1) << (raw & 63));
+        }
+        count -= keys.size();
+    }
+
+    size_t count = 0;
+    uint64_t * words;
+
+private:
+    static inline std::mutex spare_mutex;
+    static inline std::vector<std::unique_ptr<dense_states_set>> spare;
+};
+
+// every state one move before robots, and the move from it. Any robot that
+// moves stops next to a wall or robot, so rather than working that out
+// backwards just try every square in line with each robot and check that the
+// move really ends at robots
+static std::vector<std::pair<robot_array, move>> parent_candidates(game_state const & game,
+                                                                   robot_array const & robots)
+{
+    std::vector<std::pair<robot_array, move>> parents;
+    for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+        robot const & r = robots.get_robot(color);
+        for (direction_t dir : {UP, DOWN, LEFT, RIGHT}) {
+            for (uint8_t i = 0; i < 16; ++i) {
+                robot_array parent = robots;
+                robot & moved = parent.get_robot(color);
+                if (dir == UP || dir == DOWN) {
+                    moved.row = i;
+                } else {
+                    moved.col = i;
+                }
+
+                bool const occupied = std::any_of(parent.begin(), parent.end(), [&](robot const & other) {
+                    return &other != &moved && static_cast<position const &>(other) == moved;
+                });
+                if (moved == r || occupied || game.play(parent, {color, dir}) != robots) {
+                    continue;
+                }
+                parents.emplace_back(parent, move{color, dir});
+            }
+        }
+    }
+    return parents;
+}
+
+// find a state one move before robots whose canonical key is in prev_keys
+// (sorted), and the move from it
+static std::pair<robot_array, move> find_parent(game_state const & game,
+                                                robot_array const & robots,
+                                                std::vector<uint32_t> const & prev_keys)
+{
+    for (auto const & [parent, mv] : parent_candidates(game, robots)) {
+        if (std::binary_search(prev_keys.begin(), prev_keys.end(), game.canonical(parent).raw())) {
+            return {parent, mv};
+        }
+    }
+
+    assert(false);
+    return {};
+}
+
+// Rebuild the moves to a solution from the BFS layers, for the BFS variants
+// that keep no links. last_robots was reached in depth moves and last_move
+// finishes from it; find_parent(state, i) gives a state in layer i one move
+// before state and the move from it. Those are only the same as the real
+// states up to canonical(), so the colors are fixed up at the end
+template <typename FindParent>
+static moves_vec trace_layers(robot_array const & robots, robot_array const & last_robots,
+                              move last_move, size_t depth, FindParent find_parent)
+{
+    move path[32];
+    path[depth] = last_move;
+    robot_array current = last_robots;
+    for (size_t i = depth; i-- > 0; ) {
+        auto [parent, mv] = find_parent(current, i);
+        path[i] = mv;
+        current = parent;
+    }
+
+    // we went back through states with the same canonical key as the real
+    // ones, which can end on a start state with the robots' colors
+    // shuffled. Map each color back to the real robot on the same square
+    color_t real_color[k_num_robots];
+    for (robot const & r : current) {
+        auto it = std::find(robots.begin(), robots.end(), r);
+        assert(it != robots.end());
+        real_color[static_cast<uint8_t>(current.color_of(r))] = robots.color_of(*it);
+    }
+
+    moves_vec moves;
+    for (size_t i = 0; i <= depth; ++i) {
+        moves.emplace_back(real_color[static_cast<uint8_t>(path[i].robot_color)], path[i].dir);
+    }
+    return moves;
+}
+
+// BFS that dedupes through dense_states_set. There are no links to follow back,
+// so the sorted canonical keys of every layer are kept instead and the path is
+// found by searching for parents one layer at a time. The bitmap is fixed, but
+// the keys are 4 bytes per visited state, a quarter of a states_map slot, so
+// that part of the memory still grows with the search. They are also what
+// clears the bitmap for the next solve
+static solutions solve_bfs_dense(game_state const & game, robot_array const & robots)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    std::unique_ptr<dense_states_set> states_owner = dense_states_set::acquire();
+    dense_states_set & states_achieved = *states_owner;
+    states_achieved.insert(game.canonical(robots));
+    std::vector<robot_array> states_to_explore{robots};
+    std::vector<robot_array> next_states;
+    std::vector<std::vector<uint32_t>> layer_keys{{game.canonical(robots).raw()}};
+    std::vector<std::pair<robot_array, move>> solved;
+
+    // every state visited is in one of the layers
+    auto release_states = [&] {
+        for (std::vector<uint32_t> const & keys : layer_keys) {
+            states_achieved.erase(keys);
+        }
+        dense_states_set::release(std::move(states_owner));
+    };
+
+    size_t moves_used = 0;
+    while (solved.empty()) {
+        ++moves_used;
+
+        assert(!states_to_explore.empty());
+        size_t num_moves = 0;
+        for (robot_array const & current_robots : states_to_explore) {
+            for (move const & mv : game.final_moves(current_robots)) {
+                solved.emplace_back(current_robots, mv);
+
+                solver_printf("solution of size %zu found\n", moves_used);
+            }
+        }
+
+        std::vector<uint32_t> keys;
+        for (robot_array const & current_robots : states_to_explore) {
+            if (!solved.empty()) {
+                break;
+            }
+            if (stop_requested()) {
+                layer_keys.push_back(std::move(keys));
+                release_states();
+                return {};
+            }
+            for (auto const & [next_robots, mv] : game.successors(current_robots)) {
+                ++num_moves;
+
+                robot_array const key = game.canonical(next_robots);
+                if (states_achieved.insert(key)) {
+                    next_states.push_back(next_robots);
+                    keys.push_back(key.raw());
+                }
+            }
+        }
+
+        solver_printf("explored %zu states, %zu moves, %zu new states found\n",
+                      states_to_explore.size(), num_moves, next_states.size());
+        sols.states_expanded += states_to_explore.size();
+
+        std::sort(keys.begin(), keys.end());
+        layer_keys.push_back(std::move(keys));
+        std::swap(states_to_explore, next_states);
+        next_states.clear();
+    }
+
+    solver_printf("%zu states visited\n", states_achieved.count);
+    sols.peak_visited = states_achieved.count;
+
+    for (auto const & [last_robots, last_move] : solved) {
+        sols.add(trace_layers(robots, last_robots, last_move, moves_used - 1,
+                              [&](robot_array const & current, size_t i) {
+            return find_parent(game, current, layer_keys[i]);
+        }));
+    }
+    sols.lower_bound = sols.move_count;
+    release_states();
+
+    return sols;
+}
+
+// LSD radix sort, a byte per pass. scratch is just working space
+static void radix_sort(std::vector<uint32_t> & keys, std::vector<uint32_t> & scratch)
+{
+    scratch.resize(keys.size());
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        size_t offsets[256] = {};
+        for (uint32_t key : keys) {
+            ++offsets[(key >> shift) & 0xff];
+        }
+        // nothing to do if every key has the same byte here
+        if (std::find(std::begin(offsets), std::end(offsets), keys.size()) != std::end(offsets)) {
+            continue;
+        }
+
+        size_t sum = 0;
+        for (size_t & offset : offsets) {
+            size_t const count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (uint32_t key : keys) {
+            scratch[offsets[(key >> shift) & 0xff]++] = key;
+        }
+        std::swap(keys, scratch);
+    }
+}
+
+// BFS that dedupes by sorting instead of hashing. Each layer's children are
+// collected as canonical keys in one flat buffer, radix sorted, made unique and
+// then subtracted from the sorted keys visited so far in one linear pass, so
+// there are no random accesses into a big table. Moves can't always be undone,
+// so the children are checked against everything visited, not just the last
+// two layers. States are expanded from their canonical form, and the path is
+// found from the kept layers like solve_bfs_dense's.
+static solutions solve_bfs_sorted(game_state const & game, robot_array const & robots)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    std::vector<std::vector<uint32_t>> layer_keys{{game.canonical(robots).raw()}};
+    std::vector<uint32_t> visited = layer_keys.back();
+    std::vector<uint32_t> children;
+    std::vector<uint32_t> scratch;
+    std::vector<std::pair<robot_array, move>> solved;
+
+    size_t moves_used = 0;
+    while (solved.empty()) {
+        ++moves_used;
+
+        std::vector<uint32_t> const & layer = layer_keys.back();
+        assert(!layer.empty());
+        for (uint32_t key : layer) {
+            robot_array const current_robots = robot_array::from_raw(key);
+            for (move const & mv : game.final_moves(current_robots)) {
+                solved.emplace_back(current_robots, mv);
+
+                solver_printf("solution of size %zu found\n", moves_used);
+            }
+        }
+        sols.states_expanded += layer.size();
+        if (!solved.empty()) {
+            break;
+        }
+
+        children.clear();
+        for (uint32_t key : layer) {
+            if (stop_requested()) {
+                return {};
+            }
+            for (auto const & [next_robots, mv] : game.successors(robot_array::from_raw(key))) {
+                children.push_back(game.canonical(next_robots).raw());
+            }
+        }
+        size_t const num_moves = children.size();
+
+        radix_sort(children, scratch);
+        children.erase(std::unique(children.begin(), children.end()), children.end());
+
+        std::vector<uint32_t> next_layer;
+        std::set_difference(children.begin(), children.end(), visited.begin(), visited.end(),
+                            std::back_inserter(next_layer));
+        scratch.resize(visited.size() + next_layer.size());
+        std::merge(visited.begin(), visited.end(), next_layer.begin(), next_layer.end(),
+                   scratch.begin());
+        std::swap(visited, scratch);
+
+        solver_printf("explored %zu states, %zu moves, %zu new states found\n",
+                      layer.size(), num_moves, next_layer.size());
+        layer_keys.push_back(std::move(next_layer));
+    }
+
+    solver_printf("%zu states visited\n", visited.size());
+    sols.peak_visited = visited.size();
+
+    for (auto const & [last_robots, last_move] : solved) {
+        sols.add(trace_layers(robots, last_robots, last_move, moves_used - 1,
+                              [&](robot_array const & current, size_t i) {
+            return find_parent(game, current, layer_keys[i]);
+        }));
+    }
+    sols.lower_bound = sols.move_count;
+
+    return sols;
+}
+
+// Sorted keys in an unlinked temporary file, written and then read back in
+// chunks. The file goes away when this does
+struct key_file
+{
+    static constexpr size_t k_chunk_keys = 1 << 16;
+
+    key_file()
+    {
+        char const * dir = getenv("EXTERNAL_BFS_DIR");
+        std::string path = std::string(dir ? dir : "/tmp") + "/robots_bfs.XXXXXX";
+        fd = mkstemp(path.data());
+        assert(fd >= 0);
+        unlink(path.c_str());
+    }
+
+    key_file(key_file const &) = delete;
+    key_file & operator=(key_file const &) = delete;
+
+    ~key_file()
+    {
+        close(fd);
+    }
+
+    void push(uint32_t key)
+    {
+        assert(!reading);
+        buf.push_back(key);
+        ++count;
+        if (buf.size() == k_chunk_keys) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        do_write(fd, buf.data(), buf.size() * sizeof(uint32_t));
+        buf.clear();
+    }
+
+    // switch from writing to reading from the start. Can be called again to
+    // read it all again
+    void rewind()
+    {
+        if (!reading) {
+            flush();
+            reading = true;
+        }
+        lseek(fd, 0, SEEK_SET);
+        fill();
+    }
+
+    bool empty() const
+    {
+        return pos == buf.size();
+    }
+
+    uint32_t front() const
+    {
+        return buf[pos];
+    }
+
+    void pop()
+    {
+        if (++pos == buf.size()) {
+            fill();
+        }
+    }
+
+    size_t count = 0;
+
+private:
+    void fill()
+    {
+        buf.resize(k_chunk_keys);
+        ssize_t ret = read(fd, buf.data(), k_chunk_keys * sizeof(uint32_t));
+        assert(ret >= 0 && ret % sizeof(uint32_t) == 0);
+        buf.resize(ret / sizeof(uint32_t));
+        pos = 0;
+    }
+
+    int fd;
+    bool reading = false;
+    std::vector<uint32_t> buf;
+    size_t pos = 0;
+};
+
+// BFS with its layers on disk rather than in RAM, for searches bigger than
+// memory. Each layer is a file of sorted canonical keys, and states are
+// expanded from their canonical form, which reaches the same keys. Children
+// are gathered EXTERNAL_BFS_CHUNK keys at a time (4M by default), sorted and
+// written out as runs. The runs are then merged against the keys visited so
+// far to make the next layer. Moves can't always be undone, so duplicates can
+// come from any earlier layer, not just the last two. The visited keys are
+// kept as one more sorted file and merged with each new layer. The path is
+// found like solve_bfs_dense's, reading each layer back once.
+static solutions solve_bfs_external(game_state const & game, robot_array const & robots)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    size_t chunk_keys = size_t(1) << 22;
+    if (char * chunk_env = getenv("EXTERNAL_BFS_CHUNK")) {
+        chunk_keys = std::max(1ul, strtoul(chunk_env, NULL, 10));
+    }
+
+    std::vector<std::unique_ptr<key_file>> layers;
+    layers.push_back(std::make_unique<key_file>());
+    layers.back()->push(game.canonical(robots).raw());
+    auto visited = std::make_unique<key_file>();
+    visited->push(game.canonical(robots).raw());
+    std::vector<std::pair<robot_array, move>> solved;
+
+    std::vector<uint32_t> children;
+    children.reserve(chunk_keys);
+
+    size_t moves_used = 0;
+    while (solved.empty()) {
+        ++moves_used;
+
+        key_file & layer = *layers.back();
+        assert(layer.count != 0);
+        layer.rewind();
+
+        for (; !layer.empty(); layer.pop()) {
+            robot_array const current_robots = robot_array::from_raw(layer.front());
+            for (move const & mv : game.final_moves(current_robots)) {
+                solved.emplace_back(current_robots, mv);
+
+                solver_printf("solution of size %zu found\n", moves_used);
+            }
+        }
+        sols.states_expanded += layer.count;
+        if (!solved.empty()) {
+            break;
+        }
+
+        // children in sorted runs of at most chunk_keys
+        std::vector<std::unique_ptr<key_file>> runs;
+        auto write_run = [&] {
+            std::sort(children.begin(), children.end());
+            children.erase(std::unique(children.begin(), children.end()), children.end());
+            runs.push_back(std::make_unique<key_file>());
+            for (uint32_t key : children) {
+                runs.back()->push(key);
+            }
+            runs.back()->rewind();
+            children.clear();
+        };
+
+        size_t num_moves = 0;
+        for (layer.rewind(); !layer.empty(); layer.pop()) {
+            if (stop_requested()) {
+                return {};
+            }
+            for (auto const & [next_robots, mv] : game.successors(robot_array::from_raw(layer.front()))) {
+                ++num_moves;
+                if (children.size() == chunk_keys) {
+                    write_run();
+                }
+                children.push_back(game.canonical(next_robots).raw());
+            }
+        }
+        write_run();
+
+        // merge the runs, skip anything visited before, and write the new
+        // keys both to the next layer and into a new visited file
+        auto next_layer = std::make_unique<key_file>();
+        auto next_visited = std::make_unique<key_file>();
+        visited->rewind();
+
+        using run_head = std::pair<uint32_t, size_t>;
+        std::priority_queue<run_head, std::vector<run_head>, std::greater<run_head>> heads;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (!runs[i]->empty()) {
+                heads.push({runs[i]->front(), i});
+            }
+        }
+
+        std::optional<uint32_t> last;
+        while (!heads.empty()) {
+            auto const [key, i] = heads.top();
+            heads.pop();
+            runs[i]->pop();
+            if (!runs[i]->empty()) {
+                heads.push({runs[i]->front(), i});
+            }
+            if (key == last) {
+                continue;
+            }
+            last = key;
+
+            for (; !visited->empty() && visited->front() < key; visited->pop()) {
+                next_visited->push(visited->front());
+            }
+            if (!visited->empty() && visited->front() == key) {
+                continue;
+            }
+            next_layer->push(key);
+            next_visited->push(key);
+        }
+        for (; !visited->empty(); visited->pop()) {
+            next_visited->push(visited->front());
+        }
+
+        solver_printf("explored %zu states, %zu moves, %zu runs, %zu new states found\n",
+                      layer.count, num_moves, runs.size(), next_layer->count);
+
+        visited = std::move(next_visited);
+        layers.push_back(std::move(next_layer));
+    }
+
+    solver_printf("%zu states visited\n", visited->count);
+    sols.peak_visited = visited->count;
+
+    for (auto const & [last_robots, last_move] : solved) {
+        sols.add(trace_layers(robots, last_robots, last_move, moves_used - 1,
+                              [&](robot_array const & current, size_t i) {
+            // look for the few possible parents in one pass over the layer
+            std::vector<std::pair<robot_array, move>> const parents = parent_candidates(game, current);
+            std::vector<uint32_t> keys;
+            for (auto const & [parent, mv] : parents) {
+                keys.push_back(game.canonical(parent).raw());
+            }
+            std::vector<uint32_t> sorted_keys = keys;
+            std::sort(sorted_keys.begin(), sorted_keys.end());
+
+            for (layers[i]->rewind(); !layers[i]->empty(); layers[i]->pop()) {
+                uint32_t const key = layers[i]->front();
+                if (std::binary_search(sorted_keys.begin(), sorted_keys.end(), key)) {
+                    return parents[std::find(keys.begin(), keys.end(), key) - keys.begin()];
+                }
+            }
+            assert(false);
+            return std::pair<robot_array, move>{};
+        }));
+    }
+    sols.lower_bound = sols.move_count;
+
+    return sols;
+}
+
+// number of threads to run the BFS on, from the BFS_THREADS environment variable
+static unsigned bfs_threads()
+{
+    if (char * threads_env = getenv("BFS_THREADS")) {
+        unsigned threads = strtoul(threads_env, NULL, 10);
+        return threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    }
+    return 1;
+}
+
+// the serial solver unless BFS_VISITED=dense or more than one BFS thread was
+// asked for
+static solutions solve_bfs_any(game_state const & game, robot_array const & robots)
+{
+    char const * visited_env = getenv("BFS_VISITED");
+    if (visited_env && strcmp(visited_env, "dense") == 0) {
+        solver_printf("BFS with dense visited bitmap\n");
+        return solve_bfs_dense(game, robots);
+    }
+
+    unsigned const threads = bfs_threads();
+    if (threads > 1) {
+        solver_printf("parallel BFS on %u threads\n", threads);
+        return solve_bfs_parallel(game, robots, threads, solve_budget{});
+    }
+    return solve_bfs(game, robots);
+}
+
+// the parallel BFS on its own, on BFS_THREADS threads or all cores if that isn't
+// set, so it can be measured without the serial BFS standing in for it
+static solutions solve_bfs_parallel(game_state const & game, robot_array const & robots)
+{
+    unsigned const threads = getenv("BFS_THREADS") ? bfs_threads()
+                                                   : std::max(1u, std::thread::hardware_concurrency());
+    return solve_bfs_parallel(game, robots, threads, solve_budget{});
+}
+
+// Fixed size transposition table for the iterative deepening DFS: the fewest
+// moves each state was reached in during the current iteration. Buckets hold
+// two entries. The first is kept for the state reached in the fewest moves,
+// which stands for the biggest subtree, and the second is always replaced.
+// Entries from earlier iterations are told apart by a generation number, so
+// nothing has to be cleared between iterations
+struct transposition_table
+{
+    static constexpr size_t k_buckets = size_t(1) << 20;
+
+    struct entry
+    {
+        uint32_t key;
+        uint16_t generation; // 0 for never used
+        uint8_t moves_used;
+    };
+
+    void next_iteration()
+    {
+        if (++generation == 0) {
+            std::fill_n(entries.get(), 2 * k_buckets, entry{});
+            generation = 1;
+        }
+    }
+
+    // returns false if the state was already reached in as few moves
+    bool visit(robot_array const & robots, uint8_t moves_used)
+    {
+        uint32_t const raw = robots.raw();
+        entry * bucket = &entries[(::hash(raw) & (k_buckets - 1)) * 2];
+        for (size_t i = 0; i < 2; ++i) {
+            entry & e = bucket[i];
+            if (e.generation == generation && e.key == raw) {
+                if (e.moves_used <= moves_used) {
+                    return false;
+                }
+                e.moves_used = moves_used;
+                return true;
+            }
+        }
+
+        entry const fresh{raw, generation, moves_used};
+        if (bucket[0].generation != generation || moves_used <= bucket[0].moves_used) {
+            bucket[1] = bucket[0];
+            bucket[0] = fresh;
+        } else {
+            bucket[1] = fresh;
+        }
+        return true;
+    }
+
+    // a table no other search is using. Tables are handed back with release
+    // and kept for later solves, so a process allocates only as many as it runs
+    // searches at once, however many threads they run on
+    static std::unique_ptr<transposition_table> acquire()
+    {
+        std::lock_guard<std::mutex> lock(spare_mutex);
+        if (spare.empty()) {
+            return std::make_unique<transposition_table>();
+        }
+        std::unique_ptr<transposition_table> table = std::move(spare.back());
+        spare.pop_back();
+        return table;
+    }
+
+    static void release(std::unique_ptr<transposition_table> table)
+    {
+        std::lock_guard<std::mutex> lock(spare_mutex);
+        spare.push_back(std::move(table));
+    }
+
+    std::unique_ptr<entry[]> entries = std::make_unique<entry[]>(2 * k_buckets);
+    uint16_t generation = 0;
+
+private:
+    static inline std::mutex spare_mutex;
+    static inline std::vector<std::unique_ptr<transposition_table>> spare;
+};
+
+// look for solutions of exactly bound moves below robots, which moves got to,
+// the last of them from parent. Moves are pushed onto and popped off moves as
+// the search goes
+static void do_solve_dfs(game_state const & game, robot_array const & robots,
+                         robot_array const & parent, size_t bound,
+                         transposition_table & table, moves_vec & moves, solutions & sols)
+{
+    ++sols.states_expanded;
+    if (stop_requested()) {
+        return;
+    }
+
+    if (moves.size() + 1 == bound) {
+        for (move const & mv : game.final_moves(robots)) {
+            moves.emplace_back(mv);
+            sols.add(moves);
+            moves.pop_back();
+        }
+        return;
+    }
+
+    move const last_move = moves.empty() ? move{} : *(moves.end() - 1);
+    for (auto const & [next_robots, mv] : game.successors(robots, parent, last_move)) {
+        if (table.visit(game.canonical(next_robots), moves.size() + 1)) {
+            moves.emplace_back(mv);
+            do_solve_dfs(game, next_robots, robots, bound, table, moves, sols);
+            moves.pop_back();
+        }
+    }
+}
+
+// iterative deepening DFS. Each iteration looks one move deeper, so the first
+// one to find anything finds the shortest solutions. Memory is one move stack
+// and a transposition table borrowed for the solve, which needs no clearing
+// since its generations already tell old entries apart
+static solutions solve_dfs(game_state const & game, robot_array const & robots)
+{
+    solutions sols;
+    moves_vec moves;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.push_back(moves);
+        return sols;
+    }
+
+    // moves_vec can't hold any more than this
+    static constexpr size_t k_max_bound = 32;
+
+    std::unique_ptr<transposition_table> table_owner = transposition_table::acquire();
+    transposition_table & table = *table_owner;
+    for (size_t bound = std::max(1u, game.min_moves(robots));
+         sols.options.empty() && bound <= k_max_bound && !stop_requested(); ++bound) {
+        table.next_iteration();
+        table.visit(game.canonical(robots), 0);
+        do_solve_dfs(game, robots, robots, bound, table, moves, sols);
+    }
+    transposition_table::release(std::move(table_owner));
+    sols.peak_visited = 2 * transposition_table::k_buckets;
+
+    if (stop_requested()) {
+        // whatever was found may not be the shortest
+        return {};
+    }
+    assert(sols.options.size() > 0);
+    sols.lower_bound = sols.move_count;
+    return sols;
+}
+
+// direct-mapped cache of the states seen in the current IDA* iteration and the
+// fewest moves they were reached in. Entries just overwrite each other, so
+// memory stays fixed no matter how deep the search goes
+struct idastar_cache
+{
+    static constexpr size_t k_size = size_t(1) << 20;
+
+    void clear()
+    {
+        std::fill_n(keys.get(), k_size, 0);
+    }
+
+    // returns false if the state was already reached in as few moves
+    bool visit(robot_array const & robots, uint8_t moves_used)
+    {
+        uint32_t const raw = robots.raw();
+        size_t const index = ::hash(raw) & (k_size - 1);
+        if (keys[index] == raw && depths[index] <= moves_used) {
+            return false;
+        }
+        keys[index] = raw;
+        depths[index] = moves_used;
+        return true;
+    }
+
+    std::unique_ptr<uint32_t[]> keys = std::make_unique<uint32_t[]>(k_size);
+    std::unique_ptr<uint8_t[]> depths = std::make_unique<uint8_t[]>(k_size);
+};
+
+// returns the smallest f = moves + lower bound that went over the bound, which
+// is the bound for the next iteration
+static size_t do_solve_idastar(game_state const & game, robot_array const & robots,
+                               robot_array const & parent, moves_vec const & current_moves,
+                               size_t bound, idastar_cache & cache, solutions & sols)
+{
+    size_t next_bound = std::numeric_limits<size_t>::max();
+    size_t const moves_used = current_moves.size() + 1;
+    ++sols.states_expanded;
+    if (stop_requested()) {
+        return next_bound;
+    }
+
+    move const last_move = current_moves.empty() ? move{} : *(current_moves.end() - 1);
+    for (auto const & [next_robots, mv] : game.successors(robots, parent, last_move)) {
+        if (game.target_achieved(next_robots)) {
+            sols.add(current_moves + mv);
+            continue;
+        }
+
+        size_t const f = moves_used + game.min_moves(next_robots);
+        if (f > bound) {
+            next_bound = std::min(next_bound, f);
+        } else if (cache.visit(game.canonical(next_robots), moves_used)) {
+            next_bound = std::min(next_bound,
+                                  do_solve_idastar(game, next_robots, robots, current_moves + mv,
+                                                   bound, cache, sols));
+        }
+    }
+
+    return next_bound;
+}
+
+// iterative deepening A*: depth first search with the depth cut off by the
+// current target's distance table. Only a fixed size cache of visited states is
+// kept
+static solutions solve_idastar(game_state const & game, robot_array const & robots)
+{
+    solutions sols;
     moves_vec current_moves;
     if (game.target_achieved(robots)) {
         // degenerate solution
         sols.move_count = 0;
         sols.options.push_back(current_moves);
-    } else {
-        do_solve_dfs(game, robots, states_achieved, current_moves, sols);
+        return sols;
+    }
+
+    // moves_vec can't hold any more than this
+    static constexpr size_t k_max_bound = 32;
+
+    idastar_cache cache;
+    for (size_t bound = game.min_moves(robots); sols.options.empty() && bound <= k_max_bound; ) {
+        cache.clear();
+        cache.visit(game.canonical(robots), 0);
+        bound = do_solve_idastar(game, robots, robots, current_moves, bound, cache, sols);
+    }
+    // the cache is all there is, and it is allocated up front
+    sols.peak_visited = idastar_cache::k_size;
+
+    if (stop_requested()) {
+        return {};
+    }
+    assert(sols.options.size() > 0);
+    sols.lower_bound = sols.move_count;
+    return sols;
+}
+
+// idastar_cache for many threads. A state and the fewest moves it was reached
+// in share one word, so a thread never sees half of someone else's entry. An
+// entry is only ever written by a thread that is about to search below that
+// state, so trusting it is as safe as in idastar_cache
+struct concurrent_idastar_cache
+{
+    static constexpr size_t k_size = size_t(1) << 20;
+
+    void clear()
+    {
+        // no robot_array packs to 0, so that is never a hit
+        for (size_t i = 0; i < k_size; ++i) {
+            entries[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // returns false if the state was already reached in as few moves
+    bool visit(robot_array const & robots, uint8_t moves_used)
+    {
+        uint32_t const raw = robots.raw();
+        std::atomic<uint64_t> & entry = entries[::hash(raw) & (k_size - 1)];
+        uint64_t const old = entry.load(std::memory_order_relaxed);
+        if (old >> 8 == raw && (old & 0xff) <= moves_used) {
+            return false;
+        }
+        entry.store((uint64_t(raw) << 8) | moves_used, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> entries =
+        std::make_unique<std::atomic<uint64_t>[]>(k_size);
+};
+
+// a subtree for a parallel IDA* worker: the state at its root, the state one
+// move before it and the moves that got there
+struct idastar_task
+{
+    robot_array robots;
+    robot_array parent;
+    moves_vec moves;
+};
+
+struct idastar_worker
+{
+    std::mutex mutex;
+    std::deque<idastar_task> tasks;
+    solutions sols;
+    size_t next_bound = std::numeric_limits<size_t>::max();
+};
+
+// do_solve_idastar for one thread of solve_idastar_parallel, with moves kept in
+// place. Also cuts off anything that can't beat best, the length of the best
+// solution any thread has found. With split set, states split_depth moves deep
+// are queued on it instead of being searched
+static size_t do_solve_idastar_parallel(game_state const & game, robot_array const & robots,
+                                        robot_array const & parent, moves_vec & moves,
+                                        size_t bound, concurrent_idastar_cache & cache,
+                                        std::atomic<size_t> & best, solutions & sols,
+                                        std::deque<idastar_task> * split, size_t split_depth)
+{
+    size_t next_bound = std::numeric_limits<size_t>::max();
+    if (split && moves.size() == split_depth) {
+        split->push_back({robots, parent, moves});
+        return next_bound;
+    }
+
+    size_t const moves_used = moves.size() + 1;
+    ++sols.states_expanded;
+    if (stop_requested()) {
+        return next_bound;
+    }
+
+    move const last_move = moves.empty() ? move{} : *(moves.end() - 1);
+    for (auto const & [next_robots, mv] : game.successors(robots, parent, last_move)) {
+        if (game.target_achieved(next_robots)) {
+            moves.emplace_back(mv);
+            sols.add(moves);
+            moves.pop_back();
+
+            size_t current = best.load(std::memory_order_relaxed);
+            while (moves_used < current &&
+                   !best.compare_exchange_weak(current, moves_used, std::memory_order_relaxed)) {
+            }
+            continue;
+        }
+
+        size_t const f = moves_used + game.min_moves(next_robots);
+        if (f >= best.load(std::memory_order_relaxed)) {
+            // someone already has a solution at least as short
+            continue;
+        }
+        if (f > bound) {
+            next_bound = std::min(next_bound, f);
+        } else if (cache.visit(game.canonical(next_robots), moves_used)) {
+            moves.emplace_back(mv);
+            next_bound = std::min(next_bound,
+                                  do_solve_idastar_parallel(game, next_robots, robots, moves, bound,
+                                                            cache, best, sols, split, split_depth));
+            moves.pop_back();
+        }
+    }
+
+    return next_bound;
+}
+
+// number of threads for the parallel IDA*, from DFS_THREADS, all cores by default
+static unsigned dfs_threads()
+{
+    unsigned threads = 0;
+    if (char * threads_env = getenv("DFS_THREADS")) {
+        threads = strtoul(threads_env, NULL, 10);
+    }
+    return threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+}
+
+// IDA* on num_threads threads. Each iteration searches the first few moves on
+// this thread and leaves the subtrees below them as tasks, dealt out to the
+// workers' deques. The workers are started once, the first time an iteration
+// leaves any tasks, and then handed every iteration's tasks in turn, so easy
+// puzzles start no threads and harder ones start them only once. A worker
+// takes tasks from the back of its own deque and, once that is empty, steals
+// from the front of the others'. The workers share
+// the cache, and the length of the best solution found so far, so one finding
+// a solution stops the others from searching further. Unlike solve_idastar
+// that means only some of the shortest solutions may be returned
+static solutions solve_idastar_parallel(game_state const & game, robot_array const & robots,
+                                        unsigned num_threads)
+{
+    solutions sols;
+    moves_vec moves;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.push_back(moves);
+        return sols;
+    }
+
+    // moves_vec can't hold any more than this
+    static constexpr size_t k_max_bound = 32;
+    // up to 16^3 tasks, plenty to go round
+    static constexpr size_t k_split_depth = 3;
+
+    concurrent_idastar_cache cache;
+    std::atomic<size_t> best = std::numeric_limits<size_t>::max();
+    auto workers = std::make_unique<idastar_worker[]>(num_threads);
+
+    // the next task for worker self, if there are any left anywhere
+    auto take = [&](size_t self) -> std::optional<idastar_task> {
+        for (size_t i = 0; i < num_threads; ++i) {
+            idastar_worker & w = workers[(self + i) % num_threads];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if (w.tasks.empty()) {
+                continue;
+            }
+            idastar_task task;
+            if (i == 0) {
+                task = w.tasks.back();
+                w.tasks.pop_back();
+            } else {
+                task = w.tasks.front();
+                w.tasks.pop_front();
+            }
+            return task;
+        }
+        return std::nullopt;
+    };
+
+    size_t bound = game.min_moves(robots);
+
+    // search worker self's share of the current iteration's tasks
+    auto work = [&](size_t self) {
+        idastar_worker & w = workers[self];
+        while (std::optional<idastar_task> task = take(self)) {
+            w.next_bound = std::min(w.next_bound,
+                                    do_solve_idastar_parallel(game, task->robots, task->parent,
+                                                              task->moves, bound, cache, best,
+                                                              w.sols, nullptr, 0));
+        }
+    };
+
+    // the other workers wait for round to move on, work through that round's
+    // tasks and count themselves out of busy
+    std::mutex pool_mutex;
+    std::condition_variable pool_cv;
+    size_t round = 0;
+    size_t busy = 0;
+    bool finished = false;
+    // the workers don't share this thread's solver_stop
+    std::atomic<bool> const * const stop = solver_stop;
+    auto run_worker = [&](size_t self) {
+        solver_stop_scope scope(stop);
+        for (size_t seen = 0; ; ) {
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                pool_cv.wait(lock, [&] { return finished || round != seen; });
+                if (finished) {
+                    return;
+                }
+                seen = round;
+            }
+            work(self);
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                --busy;
+            }
+            pool_cv.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+
+    while (sols.options.empty() && bound <= k_max_bound) {
+        cache.clear();
+        cache.visit(game.canonical(robots), 0);
+
+        std::deque<idastar_task> tasks;
+        size_t next_bound = do_solve_idastar_parallel(game, robots, robots, moves, bound, cache,
+                                                      best, sols, &tasks, k_split_depth);
+        if (!tasks.empty()) {
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                workers[i % num_threads].tasks.push_back(tasks[i]);
+            }
+
+            if (threads.empty()) {
+                for (size_t i = 1; i < num_threads; ++i) {
+                    threads.emplace_back(run_worker, i);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                ++round;
+                busy = threads.size();
+            }
+            pool_cv.notify_all();
+            work(0);
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            pool_cv.wait(lock, [&] { return busy == 0; });
+        }
+
+        for (size_t i = 0; i < num_threads; ++i) {
+            idastar_worker & w = workers[i];
+            next_bound = std::min(next_bound, w.next_bound);
+            sols.states_expanded += w.sols.states_expanded;
+            for (moves_vec const & option : w.sols.options) {
+                sols.add(option);
+            }
+            w.sols = {};
+            w.next_bound = std::numeric_limits<size_t>::max();
+        }
+        bound = next_bound;
+    }
+    sols.peak_visited = concurrent_idastar_cache::k_size;
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        finished = true;
+    }
+    pool_cv.notify_all();
+    for (std::thread & t : threads) {
+        t.join();
+    }
+
+    if (stop_requested()) {
+        return {};
+    }
+    assert(sols.options.size() > 0);
+    sols.lower_bound = sols.move_count;
+    return sols;
+}
+
+static solutions solve_idastar_parallel(game_state const & game, robot_array const & robots)
+{
+    return solve_idastar_parallel(game, robots, dfs_threads());
+}
+
+// weighted A*: best first on moves + weight * lower bound from min_moves. Gives
+// up being optimal to get to a solution sooner. Stops at the first solution,
+// or with none if the budget runs out
+static solutions solve_weighted_astar(game_state const & game, robot_array const & robots,
+                                      unsigned weight, solve_budget const & budget)
+{
+    solutions sols;
+    if (game.target_achieved(robots)) {
+        // degenerate solution
+        sols.move_count = 0;
+        sols.options.emplace_back();
+
+        return sols;
+    }
+
+    struct entry
+    {
+        // lowest f first, and the deepest of those
+        bool operator<(entry const & other) const
+        {
+            return f != other.f ? f > other.f : moves_used < other.moves_used;
+        }
+
+        unsigned f;
+        unsigned moves_used;
+        robot_array robots;
+    };
+
+    states_map states_achieved;
+    states_achieved.emplace(game.canonical(robots), {robots, {}});
+    std::priority_queue<entry> open;
+    open.push({weight * game.min_moves(robots), 0, robots});
+
+    while (!open.empty()) {
+        if (stop_requested()) {
+            return {};
+        }
+        if (++sols.states_expanded % 256 == 0 && budget.exhausted(states_achieved.count)) {
+            break;
+        }
+
+        entry const current = open.top();
+        open.pop();
+        for (auto const & [next_robots, mv] : game.successors(current.robots)) {
+            if (game.target_achieved(next_robots)) {
+                sols.add(trace_moves(game, states_achieved, current.robots, current.moves_used) + mv);
+                sols.peak_visited = states_achieved.count;
+                return sols;
+            }
+            // the first way to a state is the only one kept, so its depth in
+            // states_achieved is the moves_used it was queued with
+            if (states_achieved.emplace(game.canonical(next_robots), {current.robots, mv}).second) {
+                unsigned const moves_used = current.moves_used + 1;
+                open.push({moves_used + weight * game.min_moves(next_robots), moves_used, next_robots});
+            }
+        }
+    }
+
+    sols.peak_visited = states_achieved.count;
+    return sols;
+}
+
+// Best solution to be had within the budget, for when a good answer now beats
+// the best one later. Weighted A* gets up to half the time and half the visited
+// states to find a first solution, then BFS spends what is left looking for a
+// shorter one. The lower bound is as far as the BFS got; the solution is a
+// shortest one if it matches move_count. Options are only empty if not even
+// weighted A* finished in time
+static solutions solve_anytime(game_state const & game, robot_array const & robots,
+                               solve_budget const & budget)
+{
+    static constexpr unsigned k_weight = 2;
+
+    solve_budget quick_budget = budget;
+    if (budget.deadline != std::chrono::steady_clock::time_point::max()) {
+        auto const now = std::chrono::steady_clock::now();
+        quick_budget.deadline = now + (budget.deadline - now) / 2;
+    }
+    if (budget.max_visited != std::numeric_limits<size_t>::max()) {
+        quick_budget.max_visited = budget.max_visited / 2;
+    }
+    solutions quick = solve_weighted_astar(game, robots, k_weight, quick_budget);
+
+    solve_budget exact_budget = budget;
+    if (budget.max_visited != std::numeric_limits<size_t>::max()) {
+        exact_budget.max_visited = budget.max_visited - std::min(quick.peak_visited, budget.max_visited);
+    }
+    solutions exact = solve_bfs(game, robots, exact_budget);
+
+    solutions & best = exact.options.empty() ? quick : exact;
+    best.states_expanded = quick.states_expanded + exact.states_expanded;
+    best.peak_visited = std::max(quick.peak_visited, exact.peak_visited);
+    best.lower_bound = std::max<size_t>(exact.lower_bound, game.min_moves(robots));
+    return best;
+}
+
+using solver_fn = solutions (*)(game_state const &, robot_array const &);
+
+// Run BFS, DFS and IDA* on a thread each and take the result of whichever
+// finishes first, telling the others to stop. All of them only return shortest
+// solutions, so the first result is as good as any. The winner's name goes in
+// *winner if it isn't null
+static solutions solve_portfolio(game_state const & game, robot_array const & robots,
+                                 char const ** winner)
+{
+    static constexpr std::pair<char const *, solver_fn> entrants[] = {
+        {"bfs", solve_bfs_any},
+        {"dfs", solve_dfs},
+        {"idastar", solve_idastar},
+    };
+
+    std::atomic<bool> stop = false;
+    std::mutex result_mutex;
+    solutions result;
+    char const * result_name = nullptr;
+
+    auto run = [&](size_t i) {
+        solutions sols;
+        {
+            solver_stop_scope scope(&stop);
+            sols = entrants[i].second(game, robots);
+        }
+
+        std::lock_guard<std::mutex> lock(result_mutex);
+        if (!result_name && !sols.options.empty()) {
+            result = std::move(sols);
+            result_name = entrants[i].first;
+            stop.store(true, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::size(entrants); ++i) {
+        threads.emplace_back(run, i);
+    }
+    run(0);
+    for (std::thread & t : threads) {
+        t.join();
+    }
+
+    assert(result_name);
+    if (winner) {
+        *winner = result_name;
+    }
+    return result;
+}
+
+static solutions solve_portfolio(game_state const & game, robot_array const & robots)
+{
+    return solve_portfolio(game, robots, nullptr);
+}
+
+// Shortest solutions already found, keyed by the walls, the robots and the
+// target. An open addressing table of fixed size entries in anonymous memory
+// that lasts as long as the process, or, if SOLUTION_CACHE names a file (say
+// robots_solutions.cache), in that file mapped shared so that every process
+// solving on the same board sees what the others found. Nothing is written to
+// disk unless asked for. Entries are claimed with a compare and swap and
+// never change once filled in, so readers need no locks. When all the slots a
+// key may probe are taken the solution just isn't kept
+struct solution_cache
+{
+    static constexpr uint32_t k_magic = 0x43534252; // "RBSC"
+    // bumped whenever the entry layout or the slot hash changes
+    static constexpr uint32_t k_format = 1;
+    static constexpr size_t k_default_entries = size_t(1) << 20;
+    static constexpr size_t k_max_probes = 16;
+
+    struct header
+    {
+        uint32_t magic;
+        uint32_t format;
+        uint64_t num_entries;
+    };
+
+    enum entry_state : uint32_t
+    {
+        EMPTY,
+        WRITING,
+        FULL,
+    };
+
+    struct entry
+    {
+        uint32_t state; // an entry_state, only accessed atomically
+        uint32_t fingerprint;
+        uint32_t robots;
+        target goal;
+        uint8_t move_count;
+        uint8_t pad;
+        uint8_t moves[16]; // color in the low two bits of each nibble, direction above
+    };
+    static_assert(sizeof(entry) == 32);
+
+    // the cache named by SOLUTION_CACHE if set, SOLUTION_CACHE_ENTRIES slots
+    // (1M by default) if it has to be created. Opened the first time it is
+    // asked for
+    static solution_cache & shared()
+    {
+        static solution_cache cache;
+        return cache;
     }
 
-    assert(sols.options.size() > 0);
+    solution_cache(solution_cache const &) = delete;
+    solution_cache & operator=(solution_cache const &) = delete;
+
+    ~solution_cache()
+    {
+        munmap(mem, size);
+    }
+
+    std::optional<moves_vec> find(game_state const & game, robot_array const & robots)
+    {
+        uint32_t const fingerprint = game.wall_fingerprint();
+        target const & goal = game.get_target();
+        size_t const start = slot(fingerprint, robots, goal);
+        for (size_t i = 0; i < k_max_probes; ++i) {
+            entry const & e = entries[(start + i) & (num_entries - 1)];
+            uint32_t const state = load_state(e);
+            if (state == EMPTY) {
+                break;
+            }
+            if (state == FULL && e.fingerprint == fingerprint && e.robots == robots.raw() &&
+                e.goal == goal) {
+                hits.fetch_add(1, std::memory_order_relaxed);
+                moves_vec moves;
+                for (uint8_t j = 0; j < e.move_count; ++j) {
+                    uint8_t const nibble = e.moves[j / 2] >> (j % 2 * 4);
+                    moves.emplace_back(static_cast<color_t>(nibble & 3),
+                                       static_cast<direction_t>((nibble >> 2) & 3));
+                }
+                return moves;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    // keep moves as the shortest solution from robots to the current target
+    void insert(game_state const & game, robot_array const & robots, moves_vec const & moves)
+    {
+        uint32_t const fingerprint = game.wall_fingerprint();
+        target const & goal = game.get_target();
+        size_t const start = slot(fingerprint, robots, goal);
+        for (size_t i = 0; i < k_max_probes; ++i) {
+            entry & e = entries[(start + i) & (num_entries - 1)];
+            uint32_t expected = EMPTY;
+            if (!std::atomic_ref<uint32_t>(e.state).compare_exchange_strong(expected, WRITING)) {
+                if (expected == FULL && e.fingerprint == fingerprint &&
+                    e.robots == robots.raw() && e.goal == goal) {
+                    // someone else got here first
+                    return;
+                }
+                continue;
+            }
+
+            e.fingerprint = fingerprint;
+            e.robots = robots.raw();
+            e.goal = goal;
+            e.move_count = moves.size();
+            std::fill(std::begin(e.moves), std::end(e.moves), 0);
+            size_t j = 0;
+            for (move const & mv : moves) {
+                uint8_t const nibble = static_cast<uint8_t>(mv.robot_color) |
+                    (static_cast<uint8_t>(mv.dir) << 2);
+                e.moves[j / 2] |= nibble << (j % 2 * 4);
+                ++j;
+            }
+            std::atomic_ref<uint32_t>(e.state).store(FULL, std::memory_order_release);
+            inserts.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    void print_stats(FILE * out) const
+    {
+        fprintf(out, "solution cache %s: %zu hits, %zu misses, %zu inserts\n", name.c_str(),
+                hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed),
+                inserts.load(std::memory_order_relaxed));
+    }
+
+    std::atomic<size_t> hits = 0;
+    std::atomic<size_t> misses = 0;
+    std::atomic<size_t> inserts = 0;
+
+private:
+    solution_cache()
+    {
+        char const * path = getenv("SOLUTION_CACHE");
+        path = path ? path : "";
+
+        size_t entries_wanted = k_default_entries;
+        if (char const * entries_env = getenv("SOLUTION_CACHE_ENTRIES")) {
+            entries_wanted = std::bit_ceil(std::max<size_t>(k_max_probes, strtoull(entries_env, NULL, 10)));
+        }
+
+        int fd = path[0] ? ::open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) : -1;
+        if (fd != -1) {
+            // whoever gets the lock first sizes the file and writes the header
+            flock(fd, LOCK_EX);
+            struct stat st;
+            header h{};
+            if (fstat(fd, &st) == 0 && st.st_size == 0) {
+                h = {k_magic, k_format, entries_wanted};
+                do_write(fd, &h, sizeof h);
+                if (ftruncate(fd, sizeof h + entries_wanted * sizeof(entry)) != 0) {
+                    h.magic = 0;
+                }
+            } else if (pread(fd, &h, sizeof h, 0) != sizeof h || st.st_size < 0 ||
+                       static_cast<size_t>(st.st_size) != sizeof h + h.num_entries * sizeof(entry) ||
+                       !std::has_single_bit(h.num_entries)) {
+                h.magic = 0;
+            }
+            flock(fd, LOCK_UN);
+
+            if (h.magic == k_magic && h.format == k_format) {
+                size = sizeof h + h.num_entries * sizeof(entry);
+                mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                num_entries = h.num_entries;
+                name = path;
+            } else {
+                fprintf(stderr, "can't use solution cache %s, keeping it in memory\n", path);
+            }
+            close(fd);
+        }
+
+        if (!mem || mem == MAP_FAILED) {
+            num_entries = entries_wanted;
+            size = sizeof(header) + num_entries * sizeof(entry);
+            mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            assert(mem != MAP_FAILED);
+            name = "in memory";
+        }
+        entries = reinterpret_cast<entry *>(static_cast<char *>(mem) + sizeof(header));
+    }
+
+    static uint32_t load_state(entry const & e)
+    {
+        return std::atomic_ref<uint32_t>(const_cast<uint32_t &>(e.state)).load(std::memory_order_acquire);
+    }
+
+    // the slots are shared between builds through the file, so this can't use
+    // ::hash, which differs between them
+    static size_t slot(uint32_t fingerprint, robot_array const & robots, target const & goal)
+    {
+        uint32_t const goal_bits = static_cast<uint32_t>(goal.color) |
+            (static_cast<uint32_t>(goal.shape) << 8);
+        return hash_multiply_shift(robots.raw() ^ hash_multiply_shift(fingerprint ^ goal_bits));
+    }
+
+    void * mem = nullptr;
+    size_t size = 0;
+    size_t num_entries = 0;
+    entry * entries = nullptr;
+    std::string name;
+};
+
+// the cached shortest solution if there is one, otherwise whatever solve finds,
+// which is kept if it is known to be the shortest
+static solutions solve_cached(game_state const & game, robot_array const & robots, solver_fn solve)
+{
+    solution_cache & cache = solution_cache::shared();
+    if (std::optional<moves_vec> moves = cache.find(game, robots)) {
+        solutions sols;
+        sols.add(*moves);
+        sols.lower_bound = sols.move_count;
+        return sols;
+    }
+
+    solutions sols = solve(game, robots);
+    if (!sols.options.empty() && sols.lower_bound == sols.move_count) {
+        cache.insert(game, robots, sols.options.front());
+    }
     return sols;
 }
 
+static solutions solve_cached(game_state const & game, robot_array const & robots)
+{
+    return solve_cached(game, robots, solve_bfs_any);
+}
+
+// Solves each target with the portfolio, unless the solution cache already has
+// it, or with every solver in turn to compare them if COMPARE_SOLVERS is set.
+// With DEADLINE_MS set, takes the best solution solve_anytime finds in that
+// many milliseconds and at most MAX_VISITED visited states instead
 static void play()
 {
+    bool const compare_solvers = getenv("COMPARE_SOLVERS");
+    char const * const deadline_env = getenv("DEADLINE_MS");
+    char const * const max_visited_env = getenv("MAX_VISITED");
+
     game_state game;
     robot_array robots = init_robots(game);
 
@@ -978,21 +4257,68 @@ static void play()
                to_str(game.get_target().shape), to_char(game.get_target().color),
                to_char(game.get_target().shape));
 
-        {
+        solutions sols;
+        if (compare_solvers) {
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                solutions sols = solve_dfs(game, robots);
+                auto end = std::chrono::high_resolution_clock::now();
+                auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+                printf("solve with DFS (%s engine) in %lld us\n", to_str(game.get_move_engine()), dur);
+                sols.print();
+            }
+
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                solutions sols = solve_idastar(game, robots);
+                auto end = std::chrono::high_resolution_clock::now();
+                auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+                printf("solve with IDA* (%s engine) in %lld us\n", to_str(game.get_move_engine()),
+                       static_cast<long long>(dur));
+                sols.print();
+            }
+
             auto start = std::chrono::high_resolution_clock::now();
-            solutions sols = solve_dfs(game, robots);
+            sols = solve_bfs_any(game, robots);
             auto end = std::chrono::high_resolution_clock::now();
             auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-            printf("solve with DFS in %lld us\n", dur);
+            printf("\nsolve with BFS (%s engine) in %lld us\n", to_str(game.get_move_engine()), dur);
             sols.print();
-        }
+        } else if (deadline_env) {
+            solve_budget budget;
+            budget.deadline = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(strtoul(deadline_env, NULL, 10));
+            if (max_visited_env) {
+                budget.max_visited = strtoul(max_visited_env, NULL, 10);
+            }
 
-        auto start = std::chrono::high_resolution_clock::now();
-        solutions sols = solve_bfs(game, robots);
-        auto end = std::chrono::high_resolution_clock::now();
-        auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        printf("\nsolve with BFS in %lld us\n", dur);
-        sols.print();
+            auto start = std::chrono::high_resolution_clock::now();
+            sols = solve_anytime(game, robots, budget);
+            auto end = std::chrono::high_resolution_clock::now();
+            auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            printf("\nsolve within %s ms (%s engine) in %lld us, no solution under %zu moves\n",
+                   deadline_env, to_str(game.get_move_engine()), static_cast<long long>(dur),
+                   sols.lower_bound);
+            if (sols.options.empty()) {
+                printf("nothing found in time, solving in full\n");
+                sols = solve_portfolio(game, robots, nullptr);
+            }
+            sols.print();
+        } else {
+            char const * winner = "cache";
+            auto start = std::chrono::high_resolution_clock::now();
+            if (std::optional<moves_vec> moves = solution_cache::shared().find(game, robots)) {
+                sols.add(*moves);
+            } else {
+                sols = solve_portfolio(game, robots, &winner);
+                solution_cache::shared().insert(game, robots, sols.options.front());
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            printf("\nsolve with %s first (%s engine) in %lld us\n", winner,
+                   to_str(game.get_move_engine()), static_cast<long long>(dur));
+            sols.print();
+        }
 
         int input = 0;
         while (true) {
@@ -1027,17 +4353,554 @@ static void solve_single()
 
     game.draw(robots);
 
+    solution_cache & cache = solution_cache::shared();
+    size_t const hits_before = cache.hits.load(std::memory_order_relaxed);
     auto start = std::chrono::high_resolution_clock::now();
-    solutions sols = solve_bfs(game, robots);
+    solutions sols = solve_cached(game, robots);
     auto end = std::chrono::high_resolution_clock::now();
     auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-    printf("\nsolve with BFS in %lld us\n", dur);
+    bool const hit = cache.hits.load(std::memory_order_relaxed) != hits_before;
+    printf("\nsolve with %s (%s engine) in %lld us\n", hit ? "cache" : "BFS",
+           to_str(game.get_move_engine()), static_cast<long long>(dur));
+    cache.print_stats(stdout);
     //sols.print();
 }
 
+struct named_solver
+{
+    char const * name;
+    solver_fn solve;
+};
+
+static named_solver const all_solvers[] = {
+    {"bfs", solve_bfs},
+    {"bfs_dense", solve_bfs_dense},
+    {"bfs_external", solve_bfs_external},
+    {"bfs_parallel", solve_bfs_parallel},
+    {"bfs_sorted", solve_bfs_sorted},
+    {"cached", solve_cached},
+    {"dfs", solve_dfs},
+    {"idastar", solve_idastar},
+    {"idastar_parallel", solve_idastar_parallel},
+    {"portfolio", solve_portfolio},
+};
+
+static named_solver const * find_solver(char const * name)
+{
+    for (named_solver const & s : all_solvers) {
+        if (strcmp(s.name, name) == 0) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+static std::vector<target> board_targets(game_state const & game)
+{
+    std::vector<target> targets;
+    for (uint8_t row = 0; row < k_board_height; ++row) {
+        for (uint8_t col = 0; col < k_board_width; ++col) {
+            if (std::optional<target> const & t = game.get_square({row, col}).target) {
+                targets.push_back(*t);
+            }
+        }
+    }
+    return targets;
+}
+
+// targets are written as on the board, e.g. gc for the green crescent
+static std::optional<target> parse_target(std::vector<target> const & targets, char const * str)
+{
+    auto it = std::find_if(targets.begin(), targets.end(), [&](target const & t) {
+        return to_char(t.color) == str[0] && to_char(t.shape) == str[1] && str[2] == '\0';
+    });
+    if (it == targets.end()) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+// moves written as <color><direction>,..., e.g. gU,rL
+static std::string solution_str(moves_vec const & moves)
+{
+    std::string str;
+    for (move const & mv : moves) {
+        if (&mv != moves.begin()) {
+            str += ',';
+        }
+        str += to_char(mv.robot_color);
+        str += to_str(mv.dir)[0];
+    }
+    return str;
+}
+
+struct target_solution
+{
+    target goal;
+    bool found = false;
+    moves_vec moves;
+};
+
+// One BFS from robots that finds a shortest solution for every target on the
+// board, instead of a search per target. States are keyed by the real robots,
+// since canonical() depends on the target. Stops once every target has been
+// reached or after max_depth moves; targets not reached by then are left
+// unfound.
+static std::vector<target_solution> solve_all_targets(game_state const & game,
+                                                      robot_array const & robots,
+                                                      size_t max_depth)
+{
+    std::vector<target_solution> sols;
+    // index into sols of the target on each square, -1 if there is none
+    int8_t target_index[k_board_height][k_board_width];
+    for (uint8_t row = 0; row < k_board_height; ++row) {
+        for (uint8_t col = 0; col < k_board_width; ++col) {
+            target_index[row][col] = -1;
+            if (std::optional<target> const & t = game.get_square({row, col}).target) {
+                target_index[row][col] = sols.size();
+                sols.push_back({.goal = *t, .found = false, .moves = {}});
+            }
+        }
+    }
+
+    states_map states_achieved;
+    auto identity = [](robot_array const & r) { return r; };
+    size_t unresolved = sols.size();
+
+    // mark the targets reached in a newly found state, tracing the path there
+    // only for the ones not seen before
+    auto check = [&](robot_array const & state, size_t depth) {
+        for (color_t color : {BLUE, RED, GREEN, YELLOW}) {
+            robot const & r = state.get_robot(color);
+            int8_t const i = target_index[r.row][r.col];
+            if (i < 0 || sols[i].found ||
+                (sols[i].goal.color != color && sols[i].goal.color != RAINBOW)) {
+                continue;
+            }
+            sols[i].found = true;
+            sols[i].moves = trace_moves(states_achieved, state, depth, identity);
+            --unresolved;
+        }
+    };
+
+    states_achieved.emplace(robots, {robots, {}});
+    check(robots, 0);
+
+    std::vector<robot_array> states_to_explore{robots};
+    std::vector<robot_array> next_states;
+    for (size_t depth = 1; unresolved && depth <= max_depth && !states_to_explore.empty(); ++depth) {
+        for (robot_array const & current_robots : states_to_explore) {
+            for (auto const & [next_robots, mv] : game.successors(current_robots)) {
+                if (states_achieved.emplace(next_robots, {current_robots, mv}).second) {
+                    next_states.push_back(next_robots);
+                    check(next_robots, depth);
+                }
+            }
+        }
+
+        solver_printf("depth %zu: %zu new states, %zu targets left\n",
+                      depth, next_states.size(), unresolved);
+        std::swap(states_to_explore, next_states);
+        next_states.clear();
+    }
+
+    return sols;
+}
+
+struct batch_job
+{
+    robot_array robots;
+    target goal;
+};
+
+// Jobs are read from stdin, one per line, in one of two forms:
+//
+//   pos <blue row> <blue col> <red row> <red col> <green row> <green col> <yellow row> <yellow col> <target>
+//   seed <seed> <count>
+//
+// The second form generates count random positions with init_robots from the
+// given seed, each with a random target.
+static std::vector<batch_job> read_batch_jobs(game_state const & game)
+{
+    std::vector<target> const targets = board_targets(game);
+    std::vector<batch_job> jobs;
+
+    char line[256];
+    for (size_t line_no = 1; fgets(line, sizeof line, stdin); ++line_no) {
+        unsigned pos[2 * k_num_robots];
+        char target_str[3];
+        unsigned seed;
+        size_t count;
+        if (sscanf(line, "pos %u %u %u %u %u %u %u %u %2s", &pos[0], &pos[1], &pos[2], &pos[3],
+                   &pos[4], &pos[5], &pos[6], &pos[7], target_str) == 9) {
+            batch_job job;
+            for (size_t i = 0; i < k_num_robots; ++i) {
+                if (pos[2 * i] >= k_board_height || pos[2 * i + 1] >= k_board_width) {
+                    fprintf(stderr, "line %zu: position out of range\n", line_no);
+                    exit(1);
+                }
+                static_cast<position &>(job.robots[i]) = position(pos[2 * i], pos[2 * i + 1]);
+            }
+            for (size_t i = 0; i < k_num_robots; ++i) {
+                if (std::count(job.robots.begin(), job.robots.end(), job.robots[i]) != 1) {
+                    fprintf(stderr, "line %zu: robots on the same square\n", line_no);
+                    exit(1);
+                }
+            }
+            std::optional<target> goal = parse_target(targets, target_str);
+            if (!goal) {
+                fprintf(stderr, "line %zu: unknown target %s\n", line_no, target_str);
+                exit(1);
+            }
+            job.goal = *goal;
+            jobs.push_back(job);
+        } else if (sscanf(line, "seed %u %zu", &seed, &count) == 2) {
+            rng.seed(seed);
+            std::uniform_int_distribution<size_t> target_dis(0, targets.size() - 1);
+            for (size_t i = 0; i < count; ++i) {
+                batch_job job;
+                job.robots = init_robots(game);
+                job.goal = targets[target_dis(rng)];
+                jobs.push_back(job);
+            }
+        } else if (line[0] != '\n' && line[0] != '#') {
+            fprintf(stderr, "line %zu: can't parse job\n", line_no);
+            exit(1);
+        }
+    }
+
+    return jobs;
+}
+
+// Solve a stream of jobs on a pool of threads, BATCH_THREADS of them (all cores
+// by default), with the solver named by BATCH_SOLVER (bfs by default). Prints
+// one line per job as it finishes:
+//
+//   job=<index> moves=<count> us=<time> solution=<color><direction>,...
+//
+// or moves=none and no solution if the solver gave up without one.
+static void solve_batch()
+{
+    solver_output = false;
+
+    char const * solver_env = getenv("BATCH_SOLVER");
+    named_solver const * solver = find_solver(solver_env ? solver_env : "bfs");
+    if (!solver) {
+        fprintf(stderr, "unknown solver %s\n", solver_env);
+        exit(1);
+    }
+
+    unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (char * threads_env = getenv("BATCH_THREADS")) {
+        num_threads = std::max(1ul, strtoul(threads_env, NULL, 10));
+    }
+
+    game_state const game;
+    std::vector<batch_job> const jobs = read_batch_jobs(game);
+
+    std::atomic<size_t> next_job = 0;
+    std::mutex output_mutex;
+    auto work = [&] {
+        // the target lives in the game, so every worker needs its own
+        game_state worker_game = game;
+        while (true) {
+            size_t const i = next_job.fetch_add(1, std::memory_order_relaxed);
+            if (i >= jobs.size()) {
+                break;
+            }
+
+            worker_game.set_target(jobs[i].goal);
+            auto start = std::chrono::high_resolution_clock::now();
+            solutions sols = solver->solve(worker_game, jobs[i].robots);
+            auto end = std::chrono::high_resolution_clock::now();
+            auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+            std::string line = "job=" + std::to_string(i);
+            if (sols.options.empty()) {
+                line += " moves=none us=" + std::to_string(dur);
+            } else {
+                line += " moves=" + std::to_string(sols.move_count) + " us=" + std::to_string(dur) +
+                    " solution=" + solution_str(sols.options.front());
+            }
+
+            std::lock_guard<std::mutex> lock(output_mutex);
+            puts(line.c_str());
+        }
+    };
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread & t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double const secs = std::chrono::duration<double>(end - start).count();
+
+    fprintf(stderr, "solved %zu jobs with %s on %u threads in %.3f s, %.1f jobs/s\n",
+            jobs.size(), solver->name, num_threads, secs, jobs.size() / secs);
+    if (solver->solve == static_cast<solver_fn>(solve_cached)) {
+        solution_cache::shared().print_stats(stderr);
+    }
+}
+
+// Shortest solutions for every target from the position init_robots gives for
+// SEED, all from one BFS that goes at most MAX_DEPTH (12 by default) moves
+// deep. Prints one line per target, hardest first:
+//
+//   <target> moves=<count> solution=<color><direction>,...
+//   <target> unsolved
+static void all_targets()
+{
+    size_t max_depth = 12;
+    if (char * depth_env = getenv("MAX_DEPTH")) {
+        max_depth = strtoul(depth_env, NULL, 10);
+    }
+
+    game_state game;
+    robot_array const robots = init_robots(game);
+    game.draw(robots);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<target_solution> sols = solve_all_targets(game, robots, max_depth);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::stable_sort(sols.begin(), sols.end(), [](target_solution const & a, target_solution const & b) {
+        if (a.found != b.found) {
+            return !a.found;
+        }
+        return a.moves.size() > b.moves.size();
+    });
+    for (target_solution const & sol : sols) {
+        if (sol.found) {
+            printf("%c%c moves=%zu solution=%s\n", to_char(sol.goal.color), to_char(sol.goal.shape),
+                   sol.moves.size(), solution_str(sol.moves).c_str());
+        } else {
+            printf("%c%c unsolved\n", to_char(sol.goal.color), to_char(sol.goal.shape));
+        }
+    }
+    printf("solved all targets (%s engine) in %lld us\n", to_str(game.get_move_engine()),
+           static_cast<long long>(dur));
+}
+
+// Build the two-robot pattern database for every target on the board and
+// write it where game_state looks for it, PATTERN_DB or robots_pattern.db. The
+// file is written next to the old one and renamed over it, so running solvers
+// keep the copy they mapped
+static void build_pattern_db()
+{
+    game_state game;
+    std::vector<target> const targets = board_targets(game);
+    assert(targets.size() <= pattern_db::k_max_targets);
+
+    pattern_db::header header{};
+    header.magic = pattern_db::k_magic;
+    header.fingerprint = game.wall_fingerprint();
+    header.num_targets = targets.size();
+    std::copy(targets.begin(), targets.end(), header.targets);
+
+    std::string const path = pattern_db_path();
+    std::string const tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY|O_TRUNC|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+    if (fd == -1) {
+        fprintf(stderr, "can't create %s: %s\n", tmp_path.c_str(), strerror(errno));
+        exit(1);
+    }
+    do_write(fd, &header, sizeof header);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto table = std::make_unique<uint8_t[]>(pattern_db::k_table_size);
+    for (target const & t : targets) {
+        game.set_target(t);
+        game.build_pattern_table(table.get());
+        do_write(fd, table.get(), pattern_db::k_table_size);
+
+        unsigned deepest = 0;
+        for (size_t i = 0; i < pattern_db::k_table_size; ++i) {
+            if (table[i] != std::numeric_limits<uint8_t>::max()) {
+                deepest = std::max<unsigned>(deepest, table[i]);
+            }
+        }
+        printf("%c%c: at most %u moves\n", to_char(t.color), to_char(t.shape), deepest);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto dur = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    close(fd);
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "can't rename %s: %s\n", tmp_path.c_str(), strerror(errno));
+        exit(1);
+    }
+    printf("wrote %zu tables to %s in %lld us\n", targets.size(), path.c_str(),
+           static_cast<long long>(dur));
+}
+
+struct bench_puzzle
+{
+    position robots[k_num_robots]; // blue, red, green, yellow
+    char const * target;           // as parsed by parse_target
+    size_t optimal_moves;
+};
+
+// fixed benchmark corpus, grouped by optimal solution length. The squares are
+// spelled out rather than drawn from a seed, since what the standard library's
+// distributions make of a seed differs between implementations. Don't change it
+// or results stop being comparable between builds
+static bench_puzzle const bench_corpus[] = {
+    {{{11, 13}, {4, 1}, {8, 11}, {0, 5}}, "bp", 1},
+    {{{8, 14}, {12, 10}, {13, 5}, {0, 2}}, "rg", 1},
+    {{{0, 12}, {11, 0}, {0, 15}, {3, 11}}, "rs", 2},
+    {{{11, 2}, {8, 4}, {1, 2}, {6, 6}}, "yp", 2},
+    {{{15, 14}, {8, 2}, {15, 13}, {11, 9}}, "rs", 3},
+    {{{6, 7}, {13, 14}, {11, 7}, {13, 6}}, "bs", 3},
+    {{{8, 1}, {11, 13}, {4, 1}, {8, 9}}, "yc", 4},
+    {{{3, 0}, {13, 13}, {3, 5}, {14, 15}}, "gs", 4},
+
+    {{{6, 15}, {11, 14}, {0, 2}, {4, 15}}, "rh", 5},
+    {{{12, 4}, {0, 7}, {10, 7}, {11, 13}}, "bs", 5},
+    {{{13, 13}, {2, 9}, {0, 1}, {5, 13}}, "rc", 5},
+    {{{6, 2}, {0, 14}, {8, 15}, {6, 7}}, "rp", 6},
+    {{{9, 14}, {14, 15}, {13, 9}, {0, 10}}, "yc", 6},
+    {{{13, 12}, {4, 5}, {1, 15}, {12, 7}}, "bp", 6},
+    {{{14, 15}, {5, 3}, {13, 1}, {0, 5}}, "gp", 7},
+    {{{12, 9}, {13, 14}, {15, 2}, {15, 12}}, "gg", 7},
+
+    {{{4, 2}, {8, 13}, {3, 14}, {1, 12}}, "bc", 8},
+    {{{1, 6}, {12, 6}, {3, 11}, {2, 4}}, "rp", 8},
+    {{{1, 3}, {12, 5}, {7, 15}, {11, 7}}, "bg", 9},
+    {{{13, 0}, {15, 3}, {13, 6}, {8, 13}}, "yg", 9},
+    {{{0, 5}, {7, 0}, {2, 5}, {2, 0}}, "ys", 10},
+    {{{6, 10}, {0, 1}, {12, 11}, {4, 2}}, "gp", 10},
+    {{{15, 4}, {11, 0}, {15, 5}, {3, 15}}, "bg", 11},
+    {{{9, 1}, {7, 6}, {13, 8}, {11, 3}}, "bg", 12},
+};
+
+struct bench_group
+{
+    char const * name;
+    size_t min_moves;
+    size_t max_moves;
+};
+
+static bench_group const bench_groups[] = {
+    {"easy", 0, 4},
+    {"medium", 5, 7},
+    {"hard", 8, std::numeric_limits<size_t>::max()},
+};
+
+// Time every solver in BENCH_SOLVERS (comma separated, all but cached by
+// default, since after the warmup it would only be timing cache hits) on the
+// fixed corpus, BENCH_WARMUP untimed and BENCH_REPS timed runs per puzzle.
+// Prints one JSON object per solver and group, noting the pattern database the
+// heuristics used since it changes how much IDA* and A* expand.
+static void bench()
+{
+    solver_output = false;
+
+    auto env_or = [](char const * name, size_t fallback) -> size_t {
+        char const * env = getenv(name);
+        return env ? strtoul(env, NULL, 10) : fallback;
+    };
+    size_t const warmup = env_or("BENCH_WARMUP", 1);
+    size_t const reps = std::max<size_t>(1, env_or("BENCH_REPS", 5));
+
+    std::vector<named_solver const *> solvers;
+    if (char const * solvers_env = getenv("BENCH_SOLVERS")) {
+        std::string names = solvers_env;
+        for (size_t begin = 0, end; begin <= names.size(); begin = end + 1) {
+            end = std::min(names.find(',', begin), names.size());
+            std::string const name = names.substr(begin, end - begin);
+            named_solver const * solver = find_solver(name.c_str());
+            if (!solver) {
+                fprintf(stderr, "unknown solver %s\n", name.c_str());
+                exit(1);
+            }
+            solvers.push_back(solver);
+        }
+    } else {
+        for (named_solver const & solver : all_solvers) {
+            if (strcmp(solver.name, "cached") != 0) {
+                solvers.push_back(&solver);
+            }
+        }
+    }
+
+    game_state game;
+    std::vector<target> const targets = board_targets(game);
+
+    std::string pattern_db_json = "null";
+    if (char const * path = game.get_pattern_db_path()) {
+        pattern_db_json = std::string("\"") + path + "\"";
+    }
+
+    for (named_solver const * solver : solvers) {
+        for (bench_group const & group : bench_groups) {
+            std::vector<double> latencies_us;
+            double total_us = 0;
+            size_t states_expanded = 0;
+            size_t peak_visited = 0;
+            size_t puzzles = 0;
+
+            for (bench_puzzle const & puzzle : bench_corpus) {
+                if (puzzle.optimal_moves < group.min_moves || puzzle.optimal_moves > group.max_moves) {
+                    continue;
+                }
+                ++puzzles;
+
+                robot_array robots;
+                for (size_t i = 0; i < k_num_robots; ++i) {
+                    static_cast<position &>(robots[i]) = puzzle.robots[i];
+                }
+                game.set_target(parse_target(targets, puzzle.target).value());
+
+                for (size_t i = 0; i < warmup; ++i) {
+                    solver->solve(game, robots);
+                }
+
+                for (size_t i = 0; i < reps; ++i) {
+                    auto start = std::chrono::steady_clock::now();
+                    solutions sols = solver->solve(game, robots);
+                    auto end = std::chrono::steady_clock::now();
+                    double const us = std::chrono::duration<double, std::micro>(end - start).count();
+
+                    if (sols.move_count != puzzle.optimal_moves) {
+                        fprintf(stderr, "%s solved puzzle %td target %s in %zu moves, expected %zu\n",
+                                solver->name, &puzzle - bench_corpus, puzzle.target,
+                                sols.move_count, puzzle.optimal_moves);
+                        exit(1);
+                    }
+
+                    latencies_us.push_back(us);
+                    total_us += us;
+                    states_expanded += sols.states_expanded;
+                    peak_visited = std::max(peak_visited, sols.peak_visited);
+                }
+            }
+
+            std::sort(latencies_us.begin(), latencies_us.end());
+            auto percentile = [&](double p) {
+                size_t const rank = static_cast<size_t>(std::ceil(p * latencies_us.size()));
+                return latencies_us[std::max<size_t>(rank, 1) - 1];
+            };
+
+            printf("{\"solver\": \"%s\", \"engine\": \"%s\", \"group\": \"%s\", "
+                   "\"puzzles\": %zu, \"reps\": %zu, \"median_us\": %.1f, \"p99_us\": %.1f, "
+                   "\"states_per_sec\": %.0f, \"peak_visited\": %zu, \"pattern_db\": %s}\n",
+                   solver->name, to_str(game.get_move_engine()), group.name, puzzles, reps,
+                   percentile(0.5), percentile(0.99), states_expanded / (total_us / 1e6),
+                   peak_visited, pattern_db_json.c_str());
+            fflush(stdout);
+        }
+    }
+}
+
 static void usage(char ** argv)
 {
-    fprintf(stderr, "usage: %s [play|test_movement|solve_single]\n", argv[0]);
+    fprintf(stderr, "usage: %s [play|test_movement|solve_single|solve_batch|all_targets|build_pattern_db|bench]\n", argv[0]);
     exit(1);
 }
 
@@ -1050,7 +4913,8 @@ int main(int argc, char ** argv)
         seed = std::random_device{}();
     }
 
-    printf("seed is %u\n", seed);
+    // on stderr so it doesn't end up among the results of batch and bench
+    fprintf(stderr, "seed is %u\n", seed);
     rng.seed(seed);
 
     if (argc != 2) {
@@ -1061,6 +4925,14 @@ int main(int argc, char ** argv)
         play();
     } else if (strcmp(argv[1], "solve_single") == 0) {
         solve_single();
+    } else if (strcmp(argv[1], "solve_batch") == 0) {
+        solve_batch();
+    } else if (strcmp(argv[1], "all_targets") == 0) {
+        all_targets();
+    } else if (strcmp(argv[1], "build_pattern_db") == 0) {
+        build_pattern_db();
+    } else if (strcmp(argv[1], "bench") == 0) {
+        bench();
     } else {
         fprintf(stderr, "unknown arg %s\n", argv[1]);
         usage(argv);